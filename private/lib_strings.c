@@ -5,21 +5,239 @@
 
 /* Includes ------------------------------------------------------------------*/
 
+#define _GNU_SOURCE
+
 #include "lib_strings.h"
+#include "lib_strings_dispatch.h"
+#include "lib_strings_simd.h"
+#include "lib_strings_trace.h"
 
 #include <errno.h>
+#include <malloc.h>
 #include <stdarg.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
 /* Definitions ---------------------------------------------------------------*/
 
+/* Content flags, a property is only meaningful once it is known */
+#define CONTENT_KNOWN (1U << 0)
+#define CONTENT_ASCII (1U << 1)
+#define CONTENT_NO_NUL (1U << 2)
+#define CONTENT_UTF8_KNOWN (1U << 3)
+#define CONTENT_UTF8 (1U << 4)
+#define CONTENT_MASK (CONTENT_KNOWN | CONTENT_ASCII | CONTENT_NO_NUL \
+                | CONTENT_UTF8_KNOWN | CONTENT_UTF8)
+
+/* The string is immutable, see string_freeze() */
+#define STATE_FROZEN (1U << 5)
+/* The hash of a frozen string is stored after its terminating null byte */
+#define STATE_HASHED (1U << 6)
+
+/* Storage kinds of the value of a string */
+#define STORAGE_SHIFT 8
+#define STORAGE_MASK (0x7U << STORAGE_SHIFT)
+#define STORAGE_HEAP (0U << STORAGE_SHIFT)
+#define STORAGE_MAPPED (1U << STORAGE_SHIFT)
+#define STORAGE_RESERVED (2U << STORAGE_SHIFT)
+#define STORAGE_SLAB (3U << STORAGE_SHIFT)
+#define STORAGE_ARENA (4U << STORAGE_SHIFT)
+#define STORAGE_ARENA_HEAP (5U << STORAGE_SHIFT)
+
+/* The lengths outgrew a narrow header and moved in front of the value */
+#define HEADER_OUTLINE (1U << 11)
+/* The header is part of a slab shared by a batch of strings */
+#define HEADER_SLAB (1U << 12)
+/* The header is allocated from a string arena */
+#define HEADER_ARENA (1U << 13)
+
+/* Width of the lengths in the header */
+#define HEADER_SHIFT 14
+#define HEADER_MASK (0x3U << HEADER_SHIFT)
+#define HEADER_16 (0U << HEADER_SHIFT)
+#define HEADER_32 (1U << HEADER_SHIFT)
+#define HEADER_64 (2U << HEADER_SHIFT)
+
+/* Lengths fit in a ssize_t, and neither 'len + 1' nor 'len * 2 + 1' overflow */
+#define MAX_STRING_LEN ((size_t)PTRDIFF_MAX - 1)
+
+#define HUGE_PAGE_SIZE ((size_t)2 * 1024 * 1024)
+#define RESERVATION_HEADER 64
+
+/* Size up to which the strings of a batch are packed in the same slab */
+#define SLAB_SIZE ((size_t)1024 * 1024)
+
+#define DEFAULT_ARENA_BLOCK_SIZE (64 * 1024)
+
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+#define FREEZE_FLAGS (STRING_FREEZE_FIT | STRING_FREEZE_HASH \
+                | STRING_FREEZE_READONLY)
+
+/* Bounds of the size classes requested to the allocator */
+#define SIZE_CLASS_SMALL 128
+#define SIZE_CLASS_LARGE (128 * 1024)
+
+/* Values are malloc'ed, page aligned or RESERVATION_HEADER after a page */
+_Static_assert(_Alignof(max_align_t) >= STRING_ALIGNMENT,
+                "malloc does not align values on STRING_ALIGNMENT");
+_Static_assert(RESERVATION_HEADER % STRING_ALIGNMENT == 0,
+                "reserved values are not aligned on STRING_ALIGNMENT");
+
+/**
+ * @brief Common end of the headers, directly followed by the struct string.
+ * It tells the width of the lengths stored in front of it.
+ */
 struct meta {
+        uint16_t idle;
+        uint16_t flags;
+};
+
+/**
+ * @brief Headers of the strings, the narrowest one able to hold the initial
+ * capacity is picked. A narrow header can't be widened without moving the
+ * string, so its lengths move in front of the value instead once they
+ * outgrow it.
+ */
+struct header16 {
+        uint16_t len;
+        uint16_t capacity;
+        struct meta meta;
+};
+
+struct header32 {
+        uint32_t len;
+        uint32_t capacity;
+        uint32_t unused;
+        struct meta meta;
+};
+
+struct header64 {
+        size_t len;
+        size_t capacity;
+#ifdef STRINGS_TRACE
+        unsigned long trace_id;
+#endif
+        uint32_t unused;
+        struct meta meta;
+};
+
+#define HEADER_FITS(header) (offsetof(struct header, meta) \
+                + sizeof(struct meta) == sizeof(struct header) \
+                && sizeof(struct header) % _Alignof(struct string) == 0)
+
+_Static_assert(HEADER_FITS(header16) && HEADER_FITS(header32)
+                && HEADER_FITS(header64),
+                "headers don't end right before their struct string");
+
+/**
+ * @brief Lengths of a string whose header is too narrow for them, stored right
+ * before its value.
+ */
+struct value_prefix {
         size_t len;
         size_t capacity;
 };
 
+/* Room taken in front of the value, which stays aligned */
+#define VALUE_PREFIX_SIZE ((sizeof(struct value_prefix) + STRING_ALIGNMENT \
+                - 1) & ~(size_t)(STRING_ALIGNMENT - 1))
+
+/**
+ * @brief Header of the address range reserved for a STORAGE_RESERVED value,
+ * which starts RESERVATION_HEADER bytes after it.
+ */
+struct reservation {
+        size_t size;
+};
+
+/**
+ * @brief Block holding the headers and the values of a batch of strings, freed
+ * once all of them are destroyed.
+ */
+struct slab {
+        atomic_size_t live;
+};
+
+/**
+ * @brief Header of a string allocated in a slab. Its meta is directly followed
+ * by its struct string, as for the other strings.
+ */
+struct slab_entry {
+        struct slab *slab;
+        struct header64 header;
+        struct string str;
+};
+
+_Static_assert(offsetof(struct slab_entry, str)
+                == offsetof(struct slab_entry, header)
+                                + sizeof(struct header64),
+                "slab entries don't follow the layout of the strings");
+
+/**
+ * @brief Block of a string arena. Its allocations start aligned after it and
+ * the last one is followed by the tail padding.
+ */
+struct string_arena_block {
+        struct string_arena_block *prev;
+        struct string_arena_block *next;
+        size_t size;
+        size_t used;
+};
+
+/**
+ * @brief Heap allocated value of an arena string that outgrew its arena
+ * allocation, directly followed by the value. It is linked in its arena to be
+ * released along with it.
+ */
+struct arena_value {
+        struct arena_value *prev;
+        struct arena_value *next;
+};
+
+#define ARENA_VALUE_HEADER ((sizeof(struct arena_value) + STRING_ALIGNMENT \
+                - 1) & ~(size_t)(STRING_ALIGNMENT - 1))
+
+/**
+ * @brief String arena. The blocks past the current one are left over from
+ * rewinds, they are reused before allocating new ones.
+ */
+struct string_arena {
+        struct string_arena_block *first;
+        struct string_arena_block *block;
+        struct arena_value *values;
+        size_t block_size;
+};
+
+/**
+ * @brief Header of a string allocated from an arena, laid out as a slab entry.
+ */
+struct arena_entry {
+        struct string_arena *arena;
+        struct header64 header;
+        struct string str;
+};
+
+_Static_assert(offsetof(struct arena_entry, str)
+                == offsetof(struct arena_entry, header)
+                                + sizeof(struct header64),
+                "arena entries don't follow the layout of the strings");
+
+/* Static variables ----------------------------------------------------------*/
+
+static enum string_huge_mode huge_mode = STRING_HUGE_OFF;
+static size_t huge_threshold;
+
+static unsigned int shrink_ratio;
+static unsigned int shrink_delay;
+static size_t shrink_min;
+
 /* Static functions ----------------------------------------------------------*/
 
 static struct meta *string_to_meta(const struct string *str)
@@ -32,24 +250,924 @@ static struct string *meta_to_string(const struct meta *meta)
         return (struct string *)(meta + 1);
 }
 
+static unsigned int header_of(const struct meta *meta)
+{
+        return meta->flags & HEADER_MASK;
+}
+
+static size_t header_size(unsigned int header)
+{
+        switch (header) {
+        case HEADER_16:
+                return sizeof(struct header16);
+        case HEADER_32:
+                return sizeof(struct header32);
+        default:
+                return sizeof(struct header64);
+        }
+}
+
+/**
+ * @brief Returns the start of the header ending with 'meta'.
+ */
+static void *meta_to_header(const struct meta *meta)
+{
+        return (char *)(meta + 1) - header_size(header_of(meta));
+}
+
+/**
+ * @brief Returns the narrowest header able to hold a capacity of 'capacity'
+ * bytes. Traced strings and mapped values, whose capacity must be exact, use
+ * the widest one.
+ */
+static unsigned int header_for(size_t capacity, int mapped)
+{
+#ifdef STRINGS_TRACE
+        (void)capacity;
+        (void)mapped;
+        return HEADER_64;
+#else
+        if (mapped || capacity > UINT32_MAX)
+                return HEADER_64;
+
+        return (capacity > UINT16_MAX ? HEADER_32 : HEADER_16);
+#endif
+}
+
+/**
+ * @brief Returns the largest capacity the header of 'meta' can hold.
+ */
+static size_t header_max(const struct meta *meta)
+{
+        if (meta->flags & HEADER_OUTLINE)
+                return SIZE_MAX;
+
+        switch (header_of(meta)) {
+        case HEADER_16:
+                return UINT16_MAX;
+        case HEADER_32:
+                return UINT32_MAX;
+        default:
+                return SIZE_MAX;
+        }
+}
+
+static struct value_prefix *value_to_prefix(const char *value)
+{
+        return (struct value_prefix *)value - 1;
+}
+
+/**
+ * @brief Returns the size of the room taken in front of the value of 'meta'.
+ */
+static size_t prefix_size(const struct meta *meta)
+{
+        return (meta->flags & HEADER_OUTLINE ? VALUE_PREFIX_SIZE : 0);
+}
+
+/**
+ * @brief Returns the start of the allocation holding the value of 'str'.
+ */
+static char *value_base(const struct string *str)
+{
+        return (str->value ? str->value - prefix_size(string_to_meta(str))
+                        : NULL);
+}
+
+static size_t get_len(const struct string *str)
+{
+        const struct meta *meta = string_to_meta(str);
+        const void *header = meta_to_header(meta);
+
+        if (meta->flags & HEADER_OUTLINE)
+                return value_to_prefix(str->value)->len;
+
+        switch (header_of(meta)) {
+        case HEADER_16:
+                return ((const struct header16 *)header)->len;
+        case HEADER_32:
+                return ((const struct header32 *)header)->len;
+        default:
+                return ((const struct header64 *)header)->len;
+        }
+}
+
+static size_t get_capacity(const struct string *str)
+{
+        const struct meta *meta = string_to_meta(str);
+        const void *header = meta_to_header(meta);
+
+        if (meta->flags & HEADER_OUTLINE)
+                return value_to_prefix(str->value)->capacity;
+
+        switch (header_of(meta)) {
+        case HEADER_16:
+                return ((const struct header16 *)header)->capacity;
+        case HEADER_32:
+                return ((const struct header32 *)header)->capacity;
+        default:
+                return ((const struct header64 *)header)->capacity;
+        }
+}
+
+/**
+ * @brief Sets the length of 'str' to 'len', which is lower than its capacity.
+ */
+static void set_len(struct string *str, size_t len)
+{
+        struct meta *meta = string_to_meta(str);
+        void *header = meta_to_header(meta);
+
+        if (meta->flags & HEADER_OUTLINE) {
+                value_to_prefix(str->value)->len = len;
+                return;
+        }
+
+        switch (header_of(meta)) {
+        case HEADER_16:
+                ((struct header16 *)header)->len = (uint16_t)len;
+                break;
+        case HEADER_32:
+                ((struct header32 *)header)->len = (uint32_t)len;
+                break;
+        default:
+                ((struct header64 *)header)->len = len;
+                break;
+        }
+}
+
+/**
+ * @brief Sets the capacity of 'str' to 'capacity'. A heap value larger than a
+ * narrow header can hold, rounded up by the allocator, is recorded as the
+ * largest capacity the header can hold.
+ */
+static void set_capacity(struct string *str, size_t capacity)
+{
+        struct meta *meta = string_to_meta(str);
+        void *header = meta_to_header(meta);
+
+        if (capacity > header_max(meta))
+                capacity = header_max(meta);
+
+        if (meta->flags & HEADER_OUTLINE) {
+                value_to_prefix(str->value)->capacity = capacity;
+                return;
+        }
+
+        switch (header_of(meta)) {
+        case HEADER_16:
+                ((struct header16 *)header)->capacity = (uint16_t)capacity;
+                break;
+        case HEADER_32:
+                ((struct header32 *)header)->capacity = (uint32_t)capacity;
+                break;
+        default:
+                ((struct header64 *)header)->capacity = capacity;
+                break;
+        }
+}
+
+static void init_trace_id(struct meta *meta)
+{
+#ifdef STRINGS_TRACE
+        ((struct header64 *)meta_to_header(meta))->trace_id = trace_new_id();
+#else
+        (void)meta;
+#endif
+}
+
+/**
+ * @brief Records the operation 'op' on 'str' if built with STRINGS_TRACE, the
+ * arguments are described by enum trace_op.
+ */
+static void trace(enum trace_op op, const struct string *str, size_t a,
+                size_t b, const char *content)
+{
+#ifdef STRINGS_TRACE
+        const struct meta *meta = string_to_meta(str);
+        trace_record(op, ((const struct header64 *)meta_to_header(meta))
+                        ->trace_id, a, b, content);
+#else
+        (void)op;
+        (void)str;
+        (void)a;
+        (void)b;
+        (void)content;
+#endif
+}
+
+/**
+ * @brief Replaces the content flags of 'str' by 'flags'.
+ */
+static void set_content_flags(struct string *str, unsigned int flags)
+{
+        struct meta *meta = string_to_meta(str);
+        meta->flags = (meta->flags & ~CONTENT_MASK) | (flags & CONTENT_MASK);
+}
+
+/**
+ * @brief Returns the content flags matching the result 'scan' of a content
+ * scanning kernel.
+ */
+static unsigned int scan_to_content_flags(unsigned int scan)
+{
+        unsigned int flags = CONTENT_KNOWN;
+
+        if (!(scan & SIMD_CONTENT_NON_ASCII))
+                flags |= CONTENT_ASCII | CONTENT_UTF8_KNOWN | CONTENT_UTF8;
+        if (!(scan & SIMD_CONTENT_NUL))
+                flags |= CONTENT_NO_NUL;
+
+        return flags;
+}
+
+/**
+ * @brief Returns the content flags of the char array 'src' of length 'len'.
+ */
+static unsigned int scan_content_flags(const char *src, size_t len)
+{
+        return scan_to_content_flags(simd_kernels.scan_content(src, len));
+}
+
+/**
+ * @brief Returns the content flags of the concatenation of two contents of
+ * flags 'a' and 'b'.
+ */
+static unsigned int combine_content_flags(unsigned int a, unsigned int b)
+{
+        unsigned int flags = 0;
+
+        if (a & b & CONTENT_KNOWN)
+                flags |= CONTENT_KNOWN
+                                | (a & b & (CONTENT_ASCII | CONTENT_NO_NUL));
+
+        /* Two invalid parts can form a valid sequence, two valid ones can't */
+        if (a & b & CONTENT_UTF8)
+                flags |= CONTENT_UTF8_KNOWN | CONTENT_UTF8;
+
+        return flags;
+}
+
+/**
+ * @brief Returns the content flags of the char array 'src' of length 'len'
+ * about to be added to 'dest'. It is only scanned if the flags of 'dest' are
+ * known, since they would be lost anyway otherwise.
+ */
+static unsigned int added_content_flags(const struct string *dest,
+                const char *src, size_t len)
+{
+        if (!(string_to_meta(dest)->flags & CONTENT_KNOWN))
+                return 0;
+
+        return scan_content_flags(src, len);
+}
+
+/**
+ * @brief Returns the content flags of 'str', scanning it if they are unknown.
+ */
+static unsigned int content_flags(const struct string *str)
+{
+        struct meta *meta = string_to_meta(str);
+
+        if (!(meta->flags & CONTENT_KNOWN))
+                meta->flags |= scan_to_content_flags(
+                                simd_kernels.scan_content_padded(str->value,
+                                                get_len(str)));
+
+        return meta->flags;
+}
+
+/**
+ * @brief Returns the length of the valid UTF-8 sequence starting the char
+ * array 'src' of length 'len', or 0 if it is invalid or truncated.
+ */
+static size_t utf8_sequence_len(const unsigned char *src, size_t len)
+{
+        const unsigned char c = src[0];
+        unsigned char min = 0x80, max = 0xbf;
+        size_t seq_len;
+
+        if (c >= 0xc2 && c <= 0xdf) {
+                seq_len = 2;
+        } else if (c >= 0xe0 && c <= 0xef) {
+                seq_len = 3;
+                if (c == 0xe0)
+                        min = 0xa0;
+                else if (c == 0xed)
+                        max = 0x9f;
+        } else if (c >= 0xf0 && c <= 0xf4) {
+                seq_len = 4;
+                if (c == 0xf0)
+                        min = 0x90;
+                else if (c == 0xf4)
+                        max = 0x8f;
+        } else {
+                return 0;
+        }
+
+        if (len < seq_len || src[1] < min || src[1] > max)
+                return 0;
+
+        for (size_t i = 2; i < seq_len; ++i) {
+                if ((src[i] & 0xc0) != 0x80)
+                        return 0;
+        }
+
+        return seq_len;
+}
+
+/**
+ * @brief Returns 1 if the char array 'src' of length 'len' is valid UTF-8, 0
+ * otherwise. ASCII runs are skipped a vector at a time.
+ */
+static int validate_utf8(const char *src, size_t len)
+{
+        const unsigned char *pos = (const unsigned char *)src;
+        const unsigned char *end = pos + len;
+
+        while (pos < end) {
+                size_t left = (size_t)(end - pos);
+
+                pos += simd_kernels.ascii_prefix((const char *)pos, left);
+                if (pos == end)
+                        break;
+
+                left = (size_t)(end - pos);
+                const size_t seq_len = utf8_sequence_len(pos, left);
+                if (!seq_len)
+                        return 0;
+
+                pos += seq_len;
+        }
+
+        return 1;
+}
+
+/**
+ * @brief Returns the content flags of 'str' with its UTF-8 validity known,
+ * validating it if needed.
+ */
+static unsigned int utf8_content_flags(const struct string *str)
+{
+        struct meta *meta = string_to_meta(str);
+        const unsigned int flags = content_flags(str);
+
+        if (flags & CONTENT_UTF8_KNOWN)
+                return flags;
+
+        meta->flags |= CONTENT_UTF8_KNOWN;
+        if (validate_utf8(str->value, get_len(str)))
+                meta->flags |= CONTENT_UTF8;
+
+        return meta->flags;
+}
+
+static unsigned int storage_of(const struct meta *meta)
+{
+        return meta->flags & STORAGE_MASK;
+}
+
+static void set_storage(struct meta *meta, unsigned int storage)
+{
+        meta->flags = (meta->flags & ~STORAGE_MASK) | storage;
+}
+
+static int is_frozen(const struct string *str)
+{
+        return !!(string_to_meta(str)->flags & STATE_FROZEN);
+}
+
+/**
+ * @brief Returns 1 if a value of 'capacity' bytes goes to huge pages, 0
+ * otherwise.
+ */
+static int wants_mapping(size_t capacity)
+{
+        return huge_mode != STRING_HUGE_OFF && capacity >= huge_threshold;
+}
+
+/**
+ * @brief Returns 'size' rounded up to a multiple of the power of two 'align',
+ * or 0 on overflow.
+ */
+static size_t round_up(size_t size, size_t align)
+{
+        const size_t rounded = (size + align - 1) & ~(align - 1);
+        return (rounded < size ? 0 : rounded);
+}
+
+/**
+ * @brief Maps a region of 'len' bytes, a multiple of HUGE_PAGE_SIZE, backed by
+ * huge pages.
+ *
+ * Explicit huge pages are used in STRING_HUGE_HUGETLB mode if the system has
+ * some left. Otherwise, the region is aligned on HUGE_PAGE_SIZE and advised to
+ * be backed by transparent huge pages.
+ *
+ * @return Pointer to the region on success.
+ * @return NULL on failure.
+ */
+static char *map_huge(size_t len)
+{
+        const int prot = PROT_READ | PROT_WRITE;
+        const int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+        char *region;
+
+#ifdef MAP_HUGETLB
+        if (huge_mode == STRING_HUGE_HUGETLB) {
+                region = mmap(NULL, len, prot, flags | MAP_HUGETLB, -1, 0);
+                if (region != MAP_FAILED)
+                        return region;
+        }
+#endif
+
+        region = mmap(NULL, len + HUGE_PAGE_SIZE, prot, flags, -1, 0);
+        if (region == MAP_FAILED)
+                return NULL;
+
+        /* Trim the region down to an aligned one */
+        const size_t head = (HUGE_PAGE_SIZE - (size_t)region % HUGE_PAGE_SIZE)
+                        % HUGE_PAGE_SIZE;
+        if (head)
+                munmap(region, head);
+        munmap(region + head + len, HUGE_PAGE_SIZE - head);
+        region += head;
+
+#ifdef MADV_HUGEPAGE
+        madvise(region, len, MADV_HUGEPAGE);
+#endif
+        return region;
+}
+
+static size_t page_size(void)
+{
+        static size_t size;
+
+        if (!size)
+                size = (size_t)sysconf(_SC_PAGESIZE);
+
+        return size;
+}
+
+/**
+ * @brief Returns the size of a region holding a value of 'capacity' bytes and
+ * its tail padding, or 0 on overflow.
+ */
+static size_t padded_size(size_t capacity)
+{
+        return (capacity > SIZE_MAX - STRING_TAIL_PADDING ? 0
+                        : capacity + STRING_TAIL_PADDING);
+}
+
+/**
+ * @brief Returns 'size' rounded up to the size classes of the common
+ * allocators : 16 bytes steps for small sizes, four classes per power of two
+ * up to SIZE_CLASS_LARGE, whole pages past it.
+ */
+static size_t size_class(size_t size)
+{
+        size_t step;
+
+        if (size <= SIZE_CLASS_SMALL)
+                step = 16;
+        else if (size <= SIZE_CLASS_LARGE)
+                step = ((size_t)1 << (sizeof(unsigned long long) * 8 - 1
+                                - (size_t)__builtin_clzll(size - 1))) / 4;
+        else
+                step = page_size();
+
+        const size_t rounded = round_up(size, step);
+        return (rounded ? rounded : size);
+}
+
+/**
+ * @brief Returns the size of the region holding a value of 'capacity' bytes
+ * preceded by 'prefix' bytes, or 0 on overflow.
+ */
+static size_t region_size(size_t prefix, size_t capacity)
+{
+        const size_t size = padded_size(capacity);
+        return (size && size <= SIZE_MAX - prefix ? prefix + size : 0);
+}
+
+/**
+ * @brief Moves the value of 'str' to a new region of 'capacity' bytes, heap
+ * allocated or huge pages backed depending on 'capacity'. If 'outline' is
+ * set, the lengths of 'str' move in front of the new value.
+ *
+ * @return 0 on success.
+ * @return -ENOMEM on failure.
+ */
+static int move_value(struct string *str, size_t capacity, int outline)
+{
+        struct meta *meta = string_to_meta(str);
+        const int mapped = wants_mapping(capacity);
+        const size_t old_prefix = prefix_size(meta);
+        const size_t prefix = (outline ? VALUE_PREFIX_SIZE : old_prefix);
+        size_t size = region_size(prefix, capacity);
+        char *base;
+
+        if (!size)
+                return -ENOMEM;
+
+        if (mapped) {
+                size = round_up(size, HUGE_PAGE_SIZE);
+                if (!size)
+                        return -ENOMEM;
+
+                /* Grow or shrink in place if the mapping allows it */
+                if (storage_of(meta) == STORAGE_MAPPED && prefix == old_prefix
+                                && mremap(value_base(str),
+                                                region_size(prefix,
+                                                        get_capacity(str)),
+                                                size, 0) != MAP_FAILED) {
+                        set_capacity(str, size - prefix - STRING_TAIL_PADDING);
+                        return 0;
+                }
+
+                base = map_huge(size);
+        } else {
+                base = malloc(size_class(size));
+                if (base)
+                        size = malloc_usable_size(base);
+        }
+
+        if (!base)
+                return -ENOMEM;
+
+        const size_t len = (str->value ? get_len(str) : 0);
+        capacity = size - prefix - STRING_TAIL_PADDING;
+        if (str->value) {
+                memcpy(base + prefix, str->value, (len + 1 < capacity ? len + 1
+                                : capacity));
+
+                /* Slab values are freed along with their slab */
+                if (storage_of(meta) == STORAGE_MAPPED)
+                        munmap(value_base(str), region_size(old_prefix,
+                                        get_capacity(str)));
+                else if (storage_of(meta) == STORAGE_HEAP)
+                        free(value_base(str));
+        }
+
+        str->value = base + prefix;
+        if (outline)
+                meta->flags |= HEADER_OUTLINE;
+
+        set_storage(meta, (mapped ? STORAGE_MAPPED : STORAGE_HEAP));
+        set_len(str, len);
+        set_capacity(str, capacity);
+        return 0;
+}
+
+static struct reservation *value_to_reservation(const char *value)
+{
+        return (struct reservation *)(value - RESERVATION_HEADER);
+}
+
+/**
+ * @brief Returns the maximal capacity of 'str', which is only bounded for
+ * STORAGE_RESERVED values.
+ */
+static size_t max_capacity(const struct string *str)
+{
+        if (storage_of(string_to_meta(str)) != STORAGE_RESERVED)
+                return SIZE_MAX;
+
+        return value_to_reservation(str->value)->size - RESERVATION_HEADER
+                        - STRING_TAIL_PADDING;
+}
+
+/**
+ * @brief Commits or decommits the pages of the reserved value of 'str' so
+ * that it can hold 'capacity' bytes. The value never moves.
+ *
+ * @return 0 on success.
+ * @return -ENOMEM if 'capacity' exceeds the reservation or on failure.
+ */
+static int commit_value(struct string *str, size_t capacity)
+{
+        struct reservation *reservation = value_to_reservation(str->value);
+        char *base = (char *)reservation;
+        const size_t page = page_size();
+
+        if (capacity > max_capacity(str))
+                return -ENOMEM;
+
+        const size_t committed = round_up(RESERVATION_HEADER
+                        + padded_size(get_capacity(str)), page);
+        const size_t needed = round_up(RESERVATION_HEADER
+                        + padded_size(capacity), page);
+
+        if (needed > committed) {
+                if (mprotect(base + committed, needed - committed,
+                                PROT_READ | PROT_WRITE) < 0)
+                        return -ENOMEM;
+        } else if (needed < committed) {
+                madvise(base + needed, committed - needed, MADV_DONTNEED);
+                mprotect(base + needed, committed - needed, PROT_NONE);
+        }
+
+        set_capacity(str, needed - RESERVATION_HEADER - STRING_TAIL_PADDING);
+        return 0;
+}
+
+static struct string_arena *meta_to_arena(const struct meta *meta)
+{
+        const char *entry = (const char *)meta_to_header(meta)
+                        - offsetof(struct arena_entry, header);
+        return ((const struct arena_entry *)entry)->arena;
+}
+
+static struct arena_value *value_to_arena_value(const char *value)
+{
+        return (struct arena_value *)(value - ARENA_VALUE_HEADER);
+}
+
+/**
+ * @brief Unlinks the arena value 'node' of the arena of 'meta'.
+ */
+static void unlink_arena_value(const struct meta *meta,
+                const struct arena_value *node)
+{
+        if (node->prev)
+                node->prev->next = node->next;
+        else
+                meta_to_arena(meta)->values = node->next;
+
+        if (node->next)
+                node->next->prev = node->prev;
+}
+
+/**
+ * @brief Releases the value of 'str'.
+ */
+static void release_value(const struct string *str)
+{
+        const struct meta *meta = string_to_meta(str);
+
+        switch (storage_of(meta)) {
+        case STORAGE_MAPPED:
+                munmap(value_base(str), region_size(prefix_size(meta),
+                                get_capacity(str)));
+                break;
+        case STORAGE_RESERVED:
+                munmap(value_to_reservation(str->value),
+                                value_to_reservation(str->value)->size);
+                break;
+        case STORAGE_ARENA_HEAP:
+                unlink_arena_value(meta, value_to_arena_value(str->value));
+                free(value_to_arena_value(str->value));
+                break;
+        case STORAGE_SLAB:
+        case STORAGE_ARENA:
+                break;
+        default:
+                free(value_base(str));
+                break;
+        }
+}
+
+static struct slab *meta_to_slab(const struct meta *meta)
+{
+        const char *entry = (const char *)meta_to_header(meta)
+                        - offsetof(struct slab_entry, header);
+        return ((const struct slab_entry *)entry)->slab;
+}
+
+/**
+ * @brief Drops 'count' strings of 'slab', which is freed along with its last
+ * string.
+ */
+static void put_slab(struct slab *slab, size_t count)
+{
+        if (slab && atomic_fetch_sub(&slab->live, count) == count)
+                free(slab);
+}
+
+/**
+ * @brief Releases the header 'meta' of a string whose value is released.
+ */
+static void release_header(struct meta *meta)
+{
+        /* Arena headers are released along with their arena */
+        if (meta->flags & HEADER_SLAB)
+                put_slab(meta_to_slab(meta), 1);
+        else if (!(meta->flags & HEADER_ARENA))
+                free(meta_to_header(meta));
+}
+
+static size_t arena_block_header(void)
+{
+        return round_up(sizeof(struct string_arena_block), STRING_ALIGNMENT);
+}
+
+static char *arena_block_data(struct string_arena_block *block)
+{
+        return (char *)block + arena_block_header();
+}
+
+/**
+ * @brief Makes a block of at least 'size' bytes the current block of 'arena',
+ * reusing the block following the current one if it is large enough.
+ *
+ * @return Pointer to the block on success.
+ * @return NULL on failure.
+ */
+static struct string_arena_block *push_arena_block(struct string_arena *arena,
+                size_t size)
+{
+        struct string_arena_block *next = (arena->block ? arena->block->next
+                        : arena->first);
+        struct string_arena_block *block = next;
+
+        if (!next || size > next->size) {
+                if (size < arena->block_size)
+                        size = arena->block_size;
+                if (size > SIZE_MAX - arena_block_header()
+                                - STRING_TAIL_PADDING)
+                        return NULL;
+
+                block = malloc(arena_block_header() + size
+                                + STRING_TAIL_PADDING);
+                if (!block)
+                        return NULL;
+
+                /* Insert it after the current block */
+                block->size = size;
+                block->prev = arena->block;
+                block->next = next;
+                if (next)
+                        next->prev = block;
+                if (arena->block)
+                        arena->block->next = block;
+                else
+                        arena->first = block;
+        }
+
+        block->used = 0;
+        arena->block = block;
+        return block;
+}
+
+/**
+ * @brief Allocates 'size' bytes aligned on STRING_ALIGNMENT from 'arena'.
+ *
+ * @return Pointer to the allocation on success.
+ * @return NULL on failure.
+ */
+static char *arena_alloc(struct string_arena *arena, size_t size)
+{
+        struct string_arena_block *block = arena->block;
+
+        size = round_up(size, STRING_ALIGNMENT);
+        if (!size)
+                return NULL;
+
+        if (!block || size > block->size - block->used) {
+                block = push_arena_block(arena, size);
+                if (!block)
+                        return NULL;
+        }
+
+        char *ptr = arena_block_data(block) + block->used;
+        block->used += size;
+        return ptr;
+}
+
+/**
+ * @brief Grows the arena value of 'str' to hold 'capacity' bytes. It moves to
+ * the heap rather than to the blocks of the arena, which a rewind to a mark
+ * taken after the creation of 'str' would release. It never shrinks.
+ *
+ * @return 0 on success.
+ * @return -ENOMEM on failure.
+ */
+static int grow_arena_value(struct string *str, size_t capacity)
+{
+        struct meta *meta = string_to_meta(str);
+        struct string_arena *arena = meta_to_arena(meta);
+        const int moved = (storage_of(meta) == STORAGE_ARENA_HEAP);
+
+        if (capacity <= get_capacity(str))
+                return 0;
+
+        const size_t size = region_size(ARENA_VALUE_HEADER, capacity);
+        if (!size)
+                return -ENOMEM;
+
+        struct arena_value *node = realloc(moved
+                        ? value_to_arena_value(str->value) : NULL, size);
+        if (!node)
+                return -ENOMEM;
+
+        if (!moved) {
+                memcpy((char *)node + ARENA_VALUE_HEADER, str->value,
+                                get_len(str) + 1);
+                node->prev = NULL;
+                node->next = arena->values;
+        }
+
+        /* The node may have moved, its neighbours must follow it */
+        if (node->prev)
+                node->prev->next = node;
+        else
+                arena->values = node;
+        if (node->next)
+                node->next->prev = node;
+
+        str->value = (char *)node + ARENA_VALUE_HEADER;
+        set_storage(meta, STORAGE_ARENA_HEAP);
+        set_capacity(str, capacity);
+        return 0;
+}
+
 /**
  * @brief Sets the capacity of 'str' to 'capacity' bytes.
  *
  * @return 0 on success.
  * @return -ENOMEM on failure.
+ *
+ * @note Huge pages backed values have their capacity rounded up to a multiple
+ * of the huge page size.
  */
 static int set_string_capacity(struct string *str, size_t capacity)
 {
         struct meta *meta = string_to_meta(str);
-        char *new_value = realloc(str->value, capacity);
-        if (!new_value)
+
+        if (storage_of(meta) == STORAGE_RESERVED)
+                return commit_value(str, capacity);
+        if (storage_of(meta) == STORAGE_ARENA
+                        || storage_of(meta) == STORAGE_ARENA_HEAP)
+                return grow_arena_value(str, capacity);
+
+        /* A slab value moved out to shrink would only take more memory */
+        if (storage_of(meta) == STORAGE_SLAB && capacity <= get_capacity(str))
+                return 0;
+
+        /* Mapped values need their exact capacity, which a narrow header
+         * would clamp */
+        if (capacity > header_max(meta) || (wants_mapping(capacity)
+                        && header_max(meta) < SIZE_MAX))
+                return move_value(str, capacity, 1);
+
+        if (storage_of(meta) != STORAGE_HEAP || wants_mapping(capacity))
+                return move_value(str, capacity, 0);
+
+        const size_t prefix = prefix_size(meta);
+        const size_t size = region_size(prefix, capacity);
+        if (!size)
+                return -ENOMEM;
+
+        char *base = realloc(value_base(str), size_class(size));
+        if (!base)
                 return -ENOMEM;
 
-        str->value = new_value;
-        meta->capacity = capacity;
+        /* Grow into the whole block, the allocator may have rounded it up */
+        str->value = base + prefix;
+        set_capacity(str, malloc_usable_size(base) - prefix
+                        - STRING_TAIL_PADDING);
         return 0;
 }
 
+/**
+ * @brief Shrinks the capacity of 'str' down to twice its length, without going
+ * under the minimal capacity of the shrink policy.
+ *
+ * A failure is harmless, the string simply keeps its capacity.
+ */
+static void shrink_string(struct string *str)
+{
+        const size_t target = get_len(str) * 2 + 1;
+        const size_t capacity = (target > shrink_min ? target : shrink_min);
+
+        string_to_meta(str)->idle = 0;
+        if (capacity < get_capacity(str))
+                set_string_capacity(str, capacity);
+}
+
+/**
+ * @brief Applies the shrink policy after a modification of 'str': the string
+ * shrinks once it has been under 1 / 'shrink_ratio' of its capacity for
+ * 'shrink_delay' modifications in a row.
+ *
+ * Shrinking to twice the length leaves the string far from both the growth
+ * and the shrink thresholds, so that it does not bounce between them.
+ */
+static void track_shrink(struct string *str)
+{
+        struct meta *meta = string_to_meta(str);
+        const size_t capacity = get_capacity(str);
+
+        if (!shrink_ratio || capacity <= shrink_min
+                        || get_len(str) + 1 >= capacity / shrink_ratio) {
+                meta->idle = 0;
+                return;
+        }
+
+        if (++meta->idle >= shrink_delay)
+                shrink_string(str);
+}
+
 /**
  * @brief Sets the length of 'str' to 'len' characters excluding the null
  * terminating byte and reallocates if needed.
@@ -59,15 +1177,23 @@ static int set_string_capacity(struct string *str, size_t capacity)
  */
 static int set_string_length(struct string *str, size_t len)
 {
-        struct meta *meta = string_to_meta(str);
+        if (len > MAX_STRING_LEN)
+                return -ENOMEM;
+
+        if (get_capacity(str) < len + 1) {
+                const size_t max = max_capacity(str);
+                if (len + 1 > max)
+                        return -ENOMEM;
 
-        if (meta->capacity < len + 1) {
-                const int res = set_string_capacity(str, len * 2 + 1);
+                const size_t capacity = len * 2 + 1;
+                const int res = set_string_capacity(str,
+                                (capacity < max ? capacity : max));
                 if (res < 0)
                         return res;
         }
 
-        meta->len = len;
+        set_len(str, len);
+        track_shrink(str);
         return 0;
 }
 
@@ -79,21 +1205,34 @@ static int set_string_length(struct string *str, size_t len)
  */
 static struct string *create_string(size_t len)
 {
-        struct meta *meta = malloc(sizeof(*meta) + sizeof(struct string));
-        if (!meta)
+        if (len > MAX_STRING_LEN)
                 return NULL;
 
+        const unsigned int header = header_for(len + 1,
+                        wants_mapping(len + 1));
+        char *base = malloc(header_size(header) + sizeof(struct string));
+        if (!base)
+                return NULL;
+
+        struct meta *meta = (struct meta *)(base + header_size(header)) - 1;
         struct string *str = meta_to_string(meta);
-        str->value = calloc(len + 1, sizeof(*str->value));
-        if (!str->value)
+        str->value = NULL;
+        meta->flags = STORAGE_HEAP | header | (len == 0 ? CONTENT_MASK : 0);
+        meta->idle = 0;
+        set_len(str, 0);
+        set_capacity(str, 0);
+        init_trace_id(meta);
+
+        if (set_string_capacity(str, len + 1) < 0)
                 goto error_alloc_value;
 
-        meta->len = len;
-        meta->capacity = len + 1;
+        str->value[0] = '\0';
+        str->value[len] = '\0';
+        set_len(str, len);
         return str;
 
 error_alloc_value:
-        free(meta);
+        free(base);
         return NULL;
 }
 
@@ -104,71 +1243,267 @@ error_alloc_value:
  * @return Pointer to the new string on success.
  * @return NULL on failure.
  */
-static struct string *sub_string(
-                const char *src, unsigned int start, size_t len)
+static struct string *sub_string(const char *src, size_t start, size_t len)
 {
         struct string *str = create_string(len);
         if (!str)
                 return NULL;
 
-        strncpy(str->value, src + start, len);
-        return str;
+        strncpy(str->value, src + start, len);
+        trace(TRACE_CREATE, str, len, 0, str->value);
+        return str;
+}
+
+/**
+ * @brief Copies the content of the char array 'src' of length 'len' and of
+ * content flags 'flags' into 'dest'.
+ *
+ * @return 0 on success.
+ * @return -EPERM if 'dest' is frozen.
+ * @return -ENOMEM on failure.
+ */
+static int copy_string(struct string *dest, const char *src, size_t len,
+                unsigned int flags)
+{
+        if (is_frozen(dest))
+                return -EPERM;
+
+        const int res = set_string_length(dest, len);
+        if (res < 0)
+                return res;
+
+        strncpy(dest->value, src, len);
+        dest->value[len] = '\0';
+        set_content_flags(dest, (len == 0 ? CONTENT_MASK : flags));
+        trace(TRACE_COPY, dest, len, 0, dest->value);
+        return 0;
+}
+
+/**
+ * @brief Appends the content of the char array 'src' of length 'len' and of
+ * content flags 'flags' at the end of 'dest'.
+ *
+ * @return 0 on success.
+ * @return -EPERM if 'dest' is frozen.
+ * @return -ENOMEM on failure.
+ */
+static int append_string(struct string *dest, const char *src, size_t len,
+                unsigned int flags)
+{
+        if (is_frozen(dest))
+                return -EPERM;
+
+        struct meta *meta = string_to_meta(dest);
+        const size_t cur_len = get_len(dest);
+        if (len > MAX_STRING_LEN - cur_len)
+                return -ENOMEM;
+
+        const int res = set_string_length(dest, cur_len + len);
+        if (res < 0)
+                return res;
+
+        strncpy(dest->value + cur_len, src, len);
+        dest->value[cur_len + len] = '\0';
+        set_content_flags(dest, combine_content_flags(meta->flags, flags));
+        trace(TRACE_APPEND, dest, len, 0, dest->value + cur_len);
+        return 0;
+}
+
+/**
+ * @brief Prepends the content of the char array 'src' of length 'len' and of
+ * content flags 'flags' at the beginning of 'dest'.
+ *
+ * @return 0 on success.
+ * @return -EPERM if 'dest' is frozen.
+ * @return -ENOMEM on failure.
+ */
+static int prepend_string(struct string *dest, const char *src, size_t len,
+                unsigned int flags)
+{
+        if (is_frozen(dest))
+                return -EPERM;
+
+        struct meta *meta = string_to_meta(dest);
+        const size_t cur_len = get_len(dest);
+        if (len > MAX_STRING_LEN - cur_len)
+                return -ENOMEM;
+
+        const int res = set_string_length(dest, cur_len + len);
+        if (res < 0)
+                return res;
+
+        memmove(dest->value + len, dest->value, cur_len);
+        strncpy(dest->value, src, len);
+        dest->value[cur_len + len] = '\0';
+        set_content_flags(dest, combine_content_flags(flags, meta->flags));
+        trace(TRACE_PREPEND, dest, len, 0, dest->value);
+        return 0;
+}
+
+/**
+ * @brief Returns the size taken in a slab by a value of length 'len'.
+ */
+static size_t slab_value_size(size_t len)
+{
+        return round_up(len + 1, STRING_ALIGNMENT);
+}
+
+/**
+ * @brief Returns the size of a slab of 'count' strings whose values take
+ * 'values_size' bytes. The values start aligned after the headers and the last
+ * one is followed by the tail padding.
+ */
+static size_t slab_size(size_t count, size_t values_size)
+{
+        return round_up(sizeof(struct slab) + count * sizeof(struct slab_entry),
+                        STRING_ALIGNMENT) + values_size + STRING_TAIL_PADDING;
+}
+
+/**
+ * @brief Duplicates the leading char arrays of 'srcs' of lengths 'lens', out
+ * of 'count', into strings packed in a single slab, stored in 'strs'. The slab
+ * is filled up to SLAB_SIZE and holds at least one string.
+ *
+ * @return The number of strings created on success.
+ * @return -ENOMEM on failure.
+ */
+static ssize_t create_slab(const char *const *srcs, const size_t *lens,
+                size_t count, struct string **strs)
+{
+        size_t values_size = slab_value_size(lens[0]);
+        size_t n = 1;
+
+        /* Lengths are bounded by MAX_STRING_LEN, the sizes can't overflow */
+        while (n < count && slab_size(n + 1, values_size
+                        + slab_value_size(lens[n])) <= SLAB_SIZE) {
+                values_size += slab_value_size(lens[n]);
+                ++n;
+        }
+
+        char *base = malloc(slab_size(n, values_size));
+        if (!base)
+                return -ENOMEM;
+
+        struct slab *slab = (struct slab *)base;
+        struct slab_entry *entries = (struct slab_entry *)(slab + 1);
+        char *value = base + slab_size(n, 0) - STRING_TAIL_PADDING;
+
+        atomic_init(&slab->live, n);
+        for (size_t i = 0; i < n; ++i) {
+                struct header64 *header = &entries[i].header;
+
+                memcpy(value, srcs[i], lens[i]);
+                value[lens[i]] = '\0';
+
+                entries[i].slab = slab;
+                entries[i].str.value = value;
+                header->len = lens[i];
+                header->capacity = slab_value_size(lens[i]);
+                header->meta.flags = STORAGE_SLAB | HEADER_SLAB | HEADER_64
+                                | (lens[i] == 0 ? CONTENT_MASK : 0);
+                header->meta.idle = 0;
+                init_trace_id(&header->meta);
+                trace(TRACE_CREATE, &entries[i].str, lens[i], 0, value);
+
+                strs[i] = &entries[i].str;
+                value += header->capacity;
+        }
+
+        return (ssize_t)n;
+}
+
+/**
+ * @brief Creates a string of length 'len' from 'arena', its header and its
+ * value in a single allocation so that the value can grow in place.
+ *
+ * @return Pointer to the new string on success.
+ * @return NULL on failure.
+ */
+static struct string *arena_string(struct string_arena *arena, size_t len)
+{
+        const size_t header = round_up(sizeof(struct arena_entry),
+                        STRING_ALIGNMENT);
+
+        if (len > MAX_STRING_LEN)
+                return NULL;
+
+        char *base = arena_alloc(arena, header + len + 1);
+        if (!base)
+                return NULL;
+
+        struct arena_entry *entry = (struct arena_entry *)base;
+
+        entry->arena = arena;
+        entry->str.value = base + header;
+        entry->str.value[len] = '\0';
+        entry->header.len = len;
+        entry->header.capacity = round_up(len + 1, STRING_ALIGNMENT);
+        entry->header.meta.flags = STORAGE_ARENA | HEADER_ARENA | HEADER_64
+                        | (len == 0 ? CONTENT_MASK : 0);
+        entry->header.meta.idle = 0;
+        init_trace_id(&entry->header.meta);
+        return &entry->str;
+}
+
+static void destroy_string(const struct string *str)
+{
+        trace(TRACE_DESTROY, str, 0, 0, NULL);
+        release_value(str);
+        release_header(string_to_meta(str));
 }
 
-/**
- * @brief Copies the content of the char array 'src' of length 'len' into
- * 'dest'.
- *
- * @return 0 on success.
- * @return -ENOMEM on failure.
- */
-static int copy_string(struct string *dest, const char *src, size_t len)
+static uint64_t hash_value(const char *src, size_t len)
 {
-        const int res = set_string_length(dest, len);
-        if (res < 0)
-                return res;
+        uint64_t hash = FNV_OFFSET;
 
-        strncpy(dest->value, src, len);
-        dest->value[len] = '\0';
-        return 0;
+        for (size_t i = 0; i < len; ++i)
+                hash = (hash ^ (unsigned char)src[i]) * FNV_PRIME;
+
+        return hash;
 }
 
 /**
- * @brief Appends the content of the char array 'src' of length 'len' at the end
- * of 'dest'.
- *
- * @return 0 on success.
- * @return -ENOMEM on failure.
+ * @brief Returns the offset of the hash of a frozen value of length 'len',
+ * aligned past its terminating null byte.
  */
-static int append_string(struct string *dest, const char *src, size_t len)
+static size_t hash_offset(size_t len)
 {
-        const size_t cur_len = string_to_meta(dest)->len;
-        const int res = set_string_length(dest, cur_len + len);
-        if (res < 0)
-                return res;
-
-        strncpy(dest->value + cur_len, src, len);
-        dest->value[cur_len + len] = '\0';
-        return 0;
+        return round_up(len + 1, sizeof(uint64_t));
 }
 
 /**
- * @brief Prepends the content of the char array 'src' of length 'len' at the
- * beginning of 'dest'.
+ * @brief Moves the first 'capacity' bytes of the value of 'str' to pages
+ * mapped read-only.
  *
  * @return 0 on success.
- * @return -ENOMEM on failure.
+ * @return -ENOMEM on failure, 'str' may then have moved to writable pages.
  */
-static int prepend_string(struct string *dest, const char *src, size_t len)
+static int protect_value(struct string *str, size_t capacity)
 {
-        const size_t cur_len = string_to_meta(dest)->len;
-        const int res = set_string_length(dest, cur_len + len);
-        if (res < 0)
-                return res;
+        struct meta *meta = string_to_meta(str);
+        const size_t prefix = prefix_size(meta);
+        const size_t size = round_up(region_size(prefix, capacity),
+                        page_size());
+
+        if (!size)
+                return -ENOMEM;
+
+        char *base = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (base == MAP_FAILED)
+                return -ENOMEM;
+
+        memcpy(base, value_base(str), prefix + capacity);
+        release_value(str);
+
+        /* The lengths may be in front of the value, set them before locking */
+        str->value = base + prefix;
+        set_storage(meta, STORAGE_MAPPED);
+        set_capacity(str, capacity);
+
+        if (mprotect(base, size, PROT_READ) < 0)
+                return -ENOMEM;
 
-        memmove(dest->value + len, dest->value, cur_len);
-        strncpy(dest->value, src, len);
-        dest->value[cur_len + len] = '\0';
         return 0;
 }
 
@@ -178,7 +1513,56 @@ static int prepend_string(struct string *dest, const char *src, size_t len)
 
 struct string *string_empty()
 {
-        return create_string(0);
+        struct string *str = create_string(0);
+        if (str)
+                trace(TRACE_CREATE, str, 0, 0, str->value);
+
+        return str;
+}
+
+struct string *string_reserved(size_t max_len)
+{
+        if (max_len > MAX_STRING_LEN)
+                return NULL;
+
+        const size_t page = page_size();
+        const size_t size = round_up(RESERVATION_HEADER + max_len + 1
+                        + STRING_TAIL_PADDING, page);
+        if (!size)
+                return NULL;
+
+        struct header64 *header = malloc(sizeof(*header)
+                        + sizeof(struct string));
+        if (!header)
+                return NULL;
+
+        char *base = mmap(NULL, size, PROT_NONE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (base == MAP_FAILED)
+                goto error_reserve;
+
+        if (mprotect(base, page, PROT_READ | PROT_WRITE) < 0)
+                goto error_commit;
+
+        struct reservation *reservation = (struct reservation *)base;
+        reservation->size = size;
+
+        struct string *str = meta_to_string(&header->meta);
+        str->value = base + RESERVATION_HEADER;
+        str->value[0] = '\0';
+        header->len = 0;
+        header->capacity = page - RESERVATION_HEADER - STRING_TAIL_PADDING;
+        header->meta.flags = STORAGE_RESERVED | HEADER_64 | CONTENT_MASK;
+        header->meta.idle = 0;
+        init_trace_id(&header->meta);
+        trace(TRACE_RESERVED, str, max_len, 0, NULL);
+        return str;
+
+error_commit:
+        munmap(base, size);
+error_reserve:
+        free(header);
+        return NULL;
 }
 
 struct string *string_dup(const struct string *src)
@@ -186,7 +1570,15 @@ struct string *string_dup(const struct string *src)
         if (!src)
                 return NULL;
 
-        return sub_string(src->value, 0, string_to_meta(src)->len);
+        /* Nothing can tell a frozen string from its copies */
+        if (is_frozen(src))
+                return (struct string *)src;
+
+        struct string *str = sub_string(src->value, 0, get_len(src));
+        if (str)
+                set_content_flags(str, string_to_meta(src)->flags);
+
+        return str;
 }
 
 struct string *string_dup_c(const char *src)
@@ -205,7 +1597,7 @@ struct string *string_dup_v(const char *src, size_t len)
         return sub_string(src, 0, len);
 }
 
-struct string *string_sub_v(const char *src, unsigned int start, size_t len)
+struct string *string_sub_v(const char *src, size_t start, size_t len)
 {
         if (!src)
                 return NULL;
@@ -222,37 +1614,107 @@ struct string *string_format(const char *format, ...)
         va_start(args, format);
         va_copy(copy, args);
 
+        struct string *str = NULL;
         const int len = vsnprintf(NULL, 0, format, args);
-        struct string *str = create_string(len);
+        if (len < 0)
+                goto out;
+
+        str = create_string((size_t)len);
         if (!str)
                 goto out;
 
-        vsnprintf(str->value, string_to_meta(str)->capacity, format, copy);
+        vsnprintf(str->value, get_capacity(str), format, copy);
+        trace(TRACE_CREATE, str, (size_t)len, 0, str->value);
 out:
         va_end(args);
         va_end(copy);
         return str;
 }
 
+int string_dup_many(const char *const *srcs, const size_t *lens,
+                size_t count, struct string **strs)
+{
+        if (count > 0 && (!srcs || !lens || !strs))
+                return -EINVAL;
+
+        for (size_t i = 0; i < count; ++i) {
+                if (!srcs[i] || lens[i] > MAX_STRING_LEN)
+                        return -EINVAL;
+        }
+
+        for (size_t done = 0; done < count;) {
+                const ssize_t created = create_slab(srcs + done, lens + done,
+                                count - done, strs + done);
+                if (created < 0) {
+                        string_destroy_many(strs, done);
+                        return (int)created;
+                }
+
+                done += (size_t)created;
+        }
+
+        return 0;
+}
+
 /* Modification functions ------------*/
 
 void string_destroy(const struct string *str)
 {
-        if (!str)
+        if (!str || is_frozen(str))
+                return;
+
+        destroy_string(str);
+}
+
+void string_destroy_many(struct string *const *strs, size_t count)
+{
+        struct slab *slab = NULL;
+        size_t dropped = 0;
+
+        if (!strs)
                 return;
 
-        free(str->value);
-        free(string_to_meta(str));
+        /* Strings of the same slab are usually adjacent, drop them at once */
+        for (size_t i = 0; i < count; ++i) {
+                if (!strs[i] || is_frozen(strs[i]))
+                        continue;
+
+                struct meta *meta = string_to_meta(strs[i]);
+                trace(TRACE_DESTROY, strs[i], 0, 0, NULL);
+                release_value(strs[i]);
+
+                if (!(meta->flags & HEADER_SLAB)) {
+                        release_header(meta);
+                        continue;
+                }
+
+                if (meta_to_slab(meta) != slab) {
+                        put_slab(slab, dropped);
+                        slab = meta_to_slab(meta);
+                        dropped = 0;
+                }
+
+                ++dropped;
+        }
+
+        put_slab(slab, dropped);
 }
 
 int string_clear(struct string *str)
 {
         if (!str)
                 return -EINVAL;
+        if (is_frozen(str))
+                return -EPERM;
 
-        struct meta *meta = string_to_meta(str);
-        meta->len = 0;
+        set_len(str, 0);
         str->value[0] = '\0';
+        set_content_flags(str, CONTENT_MASK);
+        trace(TRACE_CLEAR, str, 0, 0, NULL);
+
+        if (shrink_ratio)
+                shrink_string(str);
+
         return 0;
 }
 
@@ -261,7 +1723,8 @@ int string_copy(struct string *dest, const struct string *src)
         if (!dest || !src)
                 return -EINVAL;
 
-        return copy_string(dest, src->value, string_to_meta(src)->len);
+        return copy_string(dest, src->value, get_len(src),
+                        string_to_meta(src)->flags);
 }
 
 int string_copy_c(struct string *dest, const char *src)
@@ -269,7 +1732,7 @@ int string_copy_c(struct string *dest, const char *src)
         if (!dest || !src)
                 return -EINVAL;
 
-        return copy_string(dest, src, strlen(src));
+        return copy_string(dest, src, strlen(src), 0);
 }
 
 int string_copy_v(struct string *dest, const char *src, size_t len)
@@ -277,7 +1740,7 @@ int string_copy_v(struct string *dest, const char *src, size_t len)
         if (!dest || !src)
                 return -EINVAL;
 
-        return copy_string(dest, src, len);
+        return copy_string(dest, src, len, 0);
 }
 
 int string_append(struct string *dest, const struct string *src)
@@ -285,7 +1748,8 @@ int string_append(struct string *dest, const struct string *src)
         if (!dest || !src)
                 return -EINVAL;
 
-        return append_string(dest, src->value, string_to_meta(src)->len);
+        return append_string(dest, src->value, get_len(src),
+                        string_to_meta(src)->flags);
 }
 
 int string_append_c(struct string *dest, const char *src)
@@ -293,7 +1757,9 @@ int string_append_c(struct string *dest, const char *src)
         if (!dest || !src)
                 return -EINVAL;
 
-        return append_string(dest, src, strlen(src));
+        const size_t len = strlen(src);
+        return append_string(dest, src, len,
+                        added_content_flags(dest, src, len));
 }
 
 int string_append_v(struct string *dest, const char *src, size_t len)
@@ -301,7 +1767,8 @@ int string_append_v(struct string *dest, const char *src, size_t len)
         if (!dest || !src)
                 return -EINVAL;
 
-        return append_string(dest, src, len);
+        return append_string(dest, src, len,
+                        added_content_flags(dest, src, len));
 }
 
 int string_prepend(struct string *dest, const struct string *src)
@@ -309,7 +1776,8 @@ int string_prepend(struct string *dest, const struct string *src)
         if (!dest || !src)
                 return -EINVAL;
 
-        return prepend_string(dest, src->value, string_to_meta(src)->len);
+        return prepend_string(dest, src->value, get_len(src),
+                        string_to_meta(src)->flags);
 }
 
 int string_prepend_c(struct string *dest, const char *src)
@@ -317,7 +1785,9 @@ int string_prepend_c(struct string *dest, const char *src)
         if (!dest || !src)
                 return -EINVAL;
 
-        return prepend_string(dest, src, strlen(src));
+        const size_t len = strlen(src);
+        return prepend_string(dest, src, len,
+                        added_content_flags(dest, src, len));
 }
 
 int string_prepend_v(struct string *dest, const char *src, size_t len)
@@ -325,37 +1795,85 @@ int string_prepend_v(struct string *dest, const char *src, size_t len)
         if (!dest || !src)
                 return -EINVAL;
 
-        return prepend_string(dest, src, len);
+        return prepend_string(dest, src, len,
+                        added_content_flags(dest, src, len));
 }
 
-int string_cut(struct string *str, unsigned int start, size_t len)
+int string_cut(struct string *str, size_t start, size_t len)
 {
         if (!str)
                 return -EINVAL;
+        if (is_frozen(str))
+                return -EPERM;
 
-        struct meta *meta = string_to_meta(str);
-        if (meta->len < start + len)
+        const size_t cur_len = get_len(str);
+        if (start > cur_len || len > cur_len - start)
                 return -ERANGE;
 
         memmove(str->value, str->value + start, len);
         str->value[len] = '\0';
-        meta->len = len;
+        set_len(str, len);
+        trace(TRACE_CUT, str, len, start, NULL);
+        track_shrink(str);
+
+        /* Substrings of an ASCII string without '\0' are too, other flags may
+         * change */
+        const unsigned int kept = CONTENT_MASK & ~CONTENT_UTF8_KNOWN;
+        if ((string_to_meta(str)->flags & kept) != kept)
+                set_content_flags(str, (len == 0 ? CONTENT_MASK : 0));
+        return 0;
+}
+
+int string_resize(struct string *str, size_t len)
+{
+        if (!str)
+                return -EINVAL;
+        if (is_frozen(str))
+                return -EPERM;
+
+        const int res = set_string_length(str, len);
+        if (res < 0)
+                return res;
+
+        str->value[len] = '\0';
+        set_content_flags(str, 0);
+        trace(TRACE_RESIZE, str, len, 0, NULL);
         return 0;
 }
 
-int string_printf(struct string *str, const char *format, ...)
+void string_invalidate(struct string *str)
+{
+        if (!str || is_frozen(str))
+                return;
+
+        set_content_flags(str, 0);
+}
+
+ssize_t string_printf(struct string *str, const char *format, ...)
 {
         if (!str || !format)
                 return -EINVAL;
+        if (is_frozen(str))
+                return -EPERM;
 
         va_list args;
         va_start(args, format);
-        struct meta *meta = string_to_meta(str);
-
-        const int res = vsnprintf(str->value, meta->capacity, format, args);
-        meta->len = ((size_t)res < meta->capacity ? res : meta->capacity - 1);
+        const size_t capacity = get_capacity(str);
 
+        const int res = vsnprintf(str->value, capacity, format, args);
         va_end(args);
+
+        if (res < 0) {
+                set_len(str, 0);
+                str->value[0] = '\0';
+                set_content_flags(str, CONTENT_MASK);
+                trace(TRACE_PRINTF, str, 0, 0, str->value);
+                return -EOVERFLOW;
+        }
+
+        set_len(str, ((size_t)res < capacity ? (size_t)res : capacity - 1));
+        set_content_flags(str, 0);
+        trace(TRACE_PRINTF, str, get_len(str), 0, str->value);
         return res;
 }
 
@@ -366,7 +1884,7 @@ ssize_t string_len(const struct string *str)
         if (!str)
                 return -EINVAL;
 
-        return (ssize_t)string_to_meta(str)->len;
+        return (ssize_t)get_len(str);
 }
 
 ssize_t string_capacity(const struct string *str)
@@ -374,15 +1892,18 @@ ssize_t string_capacity(const struct string *str)
         if (!str)
                 return -EINVAL;
 
-        return (ssize_t)string_to_meta(str)->capacity;
+        return (ssize_t)get_capacity(str);
 }
 
 int string_reserve(struct string *str, size_t size)
 {
         if (!str)
                 return -EINVAL;
+        if (is_frozen(str))
+                return -EPERM;
 
-        if (size <= string_to_meta(str)->capacity)
+        trace(TRACE_RESERVE, str, size, 0, NULL);
+        if (size <= get_capacity(str))
                 return 0;
 
         return set_string_capacity(str, size);
@@ -392,6 +1913,280 @@ int string_fit(struct string *str)
 {
         if (!str)
                 return -EINVAL;
+        if (is_frozen(str))
+                return -EPERM;
+
+        trace(TRACE_FIT, str, 0, 0, NULL);
+        return set_string_capacity(str, get_len(str) + 1);
+}
+
+int string_fit_all(struct string **strs, size_t count)
+{
+        if (!strs && count > 0)
+                return -EINVAL;
+
+        int res = 0;
+
+        /* Keep going on failure, every string that can shrink does */
+        for (size_t i = 0; i < count; ++i) {
+                if (!strs[i])
+                        continue;
+
+                const int fit_res = string_fit(strs[i]);
+                if (fit_res < 0 && res == 0)
+                        res = fit_res;
+        }
+
+        return res;
+}
+
+/* Configuration functions -----------*/
+
+int string_set_huge_pages(enum string_huge_mode mode, size_t threshold)
+{
+        if (mode != STRING_HUGE_OFF && mode != STRING_HUGE_MADVISE
+                        && mode != STRING_HUGE_HUGETLB)
+                return -EINVAL;
+
+        huge_mode = mode;
+        huge_threshold = threshold;
+        return 0;
+}
+
+int string_set_shrink_policy(unsigned int ratio, unsigned int delay,
+                size_t min_capacity)
+{
+        if ((ratio != 0 && ratio < 4) || delay > UINT16_MAX)
+                return -EINVAL;
+
+        shrink_ratio = ratio;
+        shrink_delay = delay;
+        shrink_min = min_capacity;
+        return 0;
+}
+
+/* Content functions -----------------*/
+
+int string_is_ascii(const struct string *str)
+{
+        if (!str)
+                return -EINVAL;
+
+        return !!(content_flags(str) & CONTENT_ASCII);
+}
+
+int string_has_nul(const struct string *str)
+{
+        if (!str)
+                return -EINVAL;
+
+        return !(content_flags(str) & CONTENT_NO_NUL);
+}
+
+int string_is_utf8(const struct string *str)
+{
+        if (!str)
+                return -EINVAL;
+
+        return !!(utf8_content_flags(str) & CONTENT_UTF8);
+}
+
+ssize_t string_utf8_len(const struct string *str)
+{
+        if (!str)
+                return -EINVAL;
+
+        const unsigned int flags = utf8_content_flags(str);
+        const size_t len = get_len(str);
+
+        if (flags & CONTENT_ASCII)
+                return (ssize_t)len;
+        if (!(flags & CONTENT_UTF8))
+                return -EILSEQ;
+
+        return (ssize_t)simd_kernels.count_utf8_chars_padded(str->value, len);
+}
+
+ssize_t string_utf8_offset(const struct string *str, size_t index)
+{
+        if (!str)
+                return -EINVAL;
+
+        const unsigned int flags = utf8_content_flags(str);
+        const size_t len = get_len(str);
+
+        if (flags & CONTENT_ASCII)
+                return (index <= len ? (ssize_t)index : -ERANGE);
+        if (!(flags & CONTENT_UTF8))
+                return -EILSEQ;
+
+        const unsigned char *value = (const unsigned char *)str->value;
+        size_t offset = 0;
+
+        for (; index > 0; --index) {
+                if (offset == len)
+                        return -ERANGE;
+
+                do {
+                        ++offset;
+                } while (offset < len && (value[offset] & 0xc0) == 0x80);
+        }
+
+        return (ssize_t)offset;
+}
+
+/* Frozen functions ------------------*/
+
+int string_freeze(struct string *str, unsigned int flags)
+{
+        if (!str || (flags & ~FREEZE_FLAGS))
+                return -EINVAL;
+        if (is_frozen(str))
+                return -EPERM;
+
+        const size_t len = get_len(str);
+        const size_t capacity = (flags & STRING_FREEZE_HASH
+                        ? hash_offset(len) + sizeof(uint64_t) : len + 1);
+        int res;
+
+        if ((flags & STRING_FREEZE_FIT) || capacity > get_capacity(str)) {
+                res = set_string_capacity(str, capacity);
+                if (res < 0)
+                        return res;
+        }
+
+        if (flags & STRING_FREEZE_HASH) {
+                const uint64_t hash = hash_value(str->value, len);
+                memcpy(str->value + hash_offset(len), &hash, sizeof(hash));
+        }
+
+        if (flags & STRING_FREEZE_READONLY) {
+                res = protect_value(str, capacity);
+                if (res < 0)
+                        return res;
+        }
+
+        /* Cache every property now, reading a frozen string never writes */
+        utf8_content_flags(str);
+        string_to_meta(str)->flags |= STATE_FROZEN
+                        | (flags & STRING_FREEZE_HASH ? STATE_HASHED : 0);
+        return 0;
+}
+
+int string_is_frozen(const struct string *str)
+{
+        if (!str)
+                return -EINVAL;
+
+        return is_frozen(str);
+}
+
+int string_hash(const struct string *str, uint64_t *hash)
+{
+        if (!str || !hash)
+                return -EINVAL;
+
+        const size_t len = get_len(str);
+
+        if (string_to_meta(str)->flags & STATE_HASHED)
+                memcpy(hash, str->value + hash_offset(len), sizeof(*hash));
+        else
+                *hash = hash_value(str->value, len);
+
+        return 0;
+}
+
+void string_destroy_frozen(const struct string *str)
+{
+        if (!str)
+                return;
+
+        destroy_string(str);
+}
+
+/* Arena functions -------------------*/
+
+struct string_arena *string_arena_create(size_t block_size)
+{
+        struct string_arena *arena = malloc(sizeof(*arena));
+        if (!arena)
+                return NULL;
+
+        arena->first = NULL;
+        arena->block = NULL;
+        arena->values = NULL;
+        arena->block_size = (block_size ? block_size
+                        : DEFAULT_ARENA_BLOCK_SIZE);
+        return arena;
+}
+
+void string_arena_destroy(struct string_arena *arena)
+{
+        if (!arena)
+                return;
+
+        while (arena->first) {
+                struct string_arena_block *block = arena->first;
+                arena->first = block->next;
+                free(block);
+        }
+
+        while (arena->values) {
+                struct arena_value *node = arena->values;
+                arena->values = node->next;
+                free(node);
+        }
+
+        free(arena);
+}
+
+struct string *string_arena_empty(struct string_arena *arena)
+{
+        if (!arena)
+                return NULL;
+
+        struct string *str = arena_string(arena, 0);
+        if (str)
+                trace(TRACE_CREATE, str, 0, 0, str->value);
+
+        return str;
+}
+
+struct string *string_arena_dup_v(struct string_arena *arena, const char *src,
+                size_t len)
+{
+        if (!arena || !src)
+                return NULL;
+
+        struct string *str = arena_string(arena, len);
+        if (!str)
+                return NULL;
+
+        memcpy(str->value, src, len);
+        trace(TRACE_CREATE, str, len, 0, str->value);
+        return str;
+}
+
+struct string_arena_mark string_arena_mark(const struct string_arena *arena)
+{
+        struct string_arena_mark mark = { NULL, 0 };
+
+        if (arena && arena->block) {
+                mark.block = arena->block;
+                mark.used = arena->block->used;
+        }
+
+        return mark;
+}
+
+void string_arena_rewind(struct string_arena *arena,
+                struct string_arena_mark mark)
+{
+        if (!arena)
+                return;
 
-        return set_string_capacity(str, string_to_meta(str)->len + 1);
+        /* The following blocks are kept for the next allocations */
+        arena->block = (struct string_arena_block *)mark.block;
+        if (arena->block)
+                arena->block->used = mark.used;
 }
@@ -0,0 +1,289 @@
+/**
+ * @author Maxence ROBIN
+ * @brief Provides an append-only buffer made of a list of chunks.
+ */
+
+/* Includes ------------------------------------------------------------------*/
+
+#include "lib_strings_chunks.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+
+/* Definitions ---------------------------------------------------------------*/
+
+#define DEFAULT_CHUNK_SIZE (64 * 1024)
+#define WRITE_BATCH 64
+
+struct string_chunk {
+        struct string_chunk *next;
+        size_t len;
+        size_t capacity;
+        char data[];
+};
+
+struct string_chunks {
+        struct string_chunk *head;
+        struct string_chunk *tail;
+        size_t chunk_size;
+        size_t len;
+};
+
+/* Static functions ----------------------------------------------------------*/
+
+/**
+ * @brief Allocates an empty chunk holding 'capacity' bytes.
+ *
+ * @return Pointer to the new chunk on success.
+ * @return NULL on failure.
+ */
+static struct string_chunk *create_chunk(size_t capacity)
+{
+        if (capacity > SIZE_MAX - sizeof(struct string_chunk))
+                return NULL;
+
+        struct string_chunk *chunk =
+                        malloc(sizeof(struct string_chunk) + capacity);
+        if (!chunk)
+                return NULL;
+
+        chunk->next = NULL;
+        chunk->len = 0;
+        chunk->capacity = capacity;
+        return chunk;
+}
+
+static void destroy_chunk_list(struct string_chunk *chunk)
+{
+        while (chunk) {
+                struct string_chunk *next = chunk->next;
+                free(chunk);
+                chunk = next;
+        }
+}
+
+/**
+ * @brief Appends the char array 'src' of length 'len' to 'chunks'. The tail
+ * chunk is filled first, the rest going to a single new chunk large enough
+ * to hold it.
+ *
+ * @return 0 on success.
+ * @return -ENOMEM on failure.
+ */
+static int append_chunks(struct string_chunks *chunks, const char *src,
+                size_t len)
+{
+        struct string_chunk *tail = chunks->tail;
+        const size_t room = tail->capacity - tail->len;
+        const size_t head_len = (len < room ? len : room);
+
+        /* Keeps the length representable by string_chunks_len() */
+        if (len > PTRDIFF_MAX - chunks->len)
+                return -ENOMEM;
+
+        if (len > head_len) {
+                const size_t rest = len - head_len;
+                struct string_chunk *chunk = create_chunk(
+                                rest > chunks->chunk_size ? rest
+                                : chunks->chunk_size);
+                if (!chunk)
+                        return -ENOMEM;
+
+                memcpy(chunk->data, src + head_len, rest);
+                chunk->len = rest;
+                tail->next = chunk;
+                chunks->tail = chunk;
+        }
+
+        memcpy(tail->data + tail->len, src, head_len);
+        tail->len += head_len;
+        chunks->len += len;
+        return 0;
+}
+
+/* API -----------------------------------------------------------------------*/
+
+struct string_chunks *string_chunks_create(size_t chunk_size)
+{
+        struct string_chunks *chunks = malloc(sizeof(*chunks));
+        if (!chunks)
+                return NULL;
+
+        chunks->chunk_size = (chunk_size ? chunk_size : DEFAULT_CHUNK_SIZE);
+        chunks->len = 0;
+        chunks->head = create_chunk(chunks->chunk_size);
+        if (!chunks->head) {
+                free(chunks);
+                return NULL;
+        }
+
+        chunks->tail = chunks->head;
+        return chunks;
+}
+
+void string_chunks_destroy(struct string_chunks *chunks)
+{
+        if (!chunks)
+                return;
+
+        destroy_chunk_list(chunks->head);
+        free(chunks);
+}
+
+int string_chunks_clear(struct string_chunks *chunks)
+{
+        if (!chunks)
+                return -EINVAL;
+
+        destroy_chunk_list(chunks->head->next);
+        chunks->head->next = NULL;
+        chunks->head->len = 0;
+        chunks->tail = chunks->head;
+        chunks->len = 0;
+        return 0;
+}
+
+int string_chunks_append(struct string_chunks *chunks,
+                const struct string *src)
+{
+        if (!chunks || !src)
+                return -EINVAL;
+
+        return append_chunks(chunks, src->value, (size_t)string_len(src));
+}
+
+int string_chunks_append_c(struct string_chunks *chunks, const char *src)
+{
+        if (!chunks || !src)
+                return -EINVAL;
+
+        return append_chunks(chunks, src, strlen(src));
+}
+
+int string_chunks_append_v(struct string_chunks *chunks, const char *src,
+                size_t len)
+{
+        if (!chunks || !src)
+                return -EINVAL;
+
+        return append_chunks(chunks, src, len);
+}
+
+ssize_t string_chunks_len(const struct string_chunks *chunks)
+{
+        if (!chunks)
+                return -EINVAL;
+
+        return (ssize_t)chunks->len;
+}
+
+int string_chunks_iter_init(struct string_chunks_iter *it,
+                const struct string_chunks *chunks)
+{
+        if (!it || !chunks)
+                return -EINVAL;
+
+        it->chunk = chunks->head;
+        return 0;
+}
+
+int string_chunks_next(struct string_chunks_iter *it,
+                struct string_view *segment)
+{
+        if (!it || !segment)
+                return -EINVAL;
+
+        while (it->chunk && it->chunk->len == 0)
+                it->chunk = it->chunk->next;
+
+        if (!it->chunk)
+                return 0;
+
+        *segment = (struct string_view){ it->chunk->data, it->chunk->len };
+        it->chunk = it->chunk->next;
+        return 1;
+}
+
+ssize_t string_chunks_write(int fd, const struct string_chunks *chunks)
+{
+        if (!chunks)
+                return -EINVAL;
+
+        const struct string_chunk *chunk = chunks->head;
+        size_t offset = 0;
+        size_t total = 0;
+
+        while (total < chunks->len) {
+                struct iovec iov[WRITE_BATCH];
+                const struct string_chunk *pos = chunk;
+                size_t skip = offset;
+                int count = 0;
+
+                /* Gather the next batch of segments, starting mid-chunk after
+                 * a partial write */
+                for (; pos && count < WRITE_BATCH; pos = pos->next) {
+                        if (pos->len == skip) {
+                                skip = 0;
+                                continue;
+                        }
+
+                        iov[count].iov_base = (char *)pos->data + skip;
+                        iov[count].iov_len = pos->len - skip;
+                        ++count;
+                        skip = 0;
+                }
+
+                const ssize_t written = writev(fd, iov, count);
+                if (written < 0) {
+                        if (errno == EINTR)
+                                continue;
+
+                        return -errno;
+                }
+
+                if (written == 0)
+                        return -EIO;
+
+                total += (size_t)written;
+
+                /* Skip the fully written chunks */
+                size_t left = (size_t)written;
+                while (chunk && left >= chunk->len - offset) {
+                        left -= chunk->len - offset;
+                        chunk = chunk->next;
+                        offset = 0;
+                }
+                offset += left;
+        }
+
+        return (ssize_t)total;
+}
+
+struct string *string_chunks_flatten(const struct string_chunks *chunks)
+{
+        if (!chunks)
+                return NULL;
+
+        struct string *str = string_empty();
+        if (!str)
+                return NULL;
+
+        /* Size the value exactly, resizing alone would double it */
+        if (string_reserve(str, chunks->len + 1) < 0
+                        || string_resize(str, chunks->len) < 0) {
+                string_destroy(str);
+                return NULL;
+        }
+
+        char *pos = str->value;
+        for (const struct string_chunk *chunk = chunks->head; chunk;
+                        chunk = chunk->next) {
+                memcpy(pos, chunk->data, chunk->len);
+                pos += chunk->len;
+        }
+
+        return str;
+}
@@ -0,0 +1,475 @@
+/**
+ * @author Maxence ROBIN
+ * @brief Provides a Myers diff between two strings.
+ *
+ * The edit script is computed with the linear space refinement of Myers' O(ND)
+ * algorithm : the middle snake of the edit graph is searched from both ends at
+ * once, then both halves are diffed recursively. The common prefix and suffix
+ * are stripped with vectorized comparisons before anything is allocated.
+ */
+
+/* Includes ------------------------------------------------------------------*/
+
+#include "lib_strings_diff.h"
+#include "lib_strings_dispatch.h"
+#include "lib_strings_simd.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/* Definitions ---------------------------------------------------------------*/
+
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+/**
+ * @brief A line of a diffed region. The line i spans from 'offset' of the
+ * entry i to 'offset' of the entry i + 1.
+ */
+struct diff_line {
+        size_t offset;
+        uint64_t hash;
+};
+
+/**
+ * @brief The diffed region of one of the strings. In lines mode, 'lines' has
+ * 'len' + 1 entries, in bytes mode it is NULL and the tokens are the bytes of
+ * the region starting at 'start'.
+ */
+struct diff_seq {
+        const char *value;
+        size_t start;
+        struct diff_line *lines;
+        size_t len;
+};
+
+struct diff_ctx {
+        struct diff_seq a;
+        struct diff_seq b;
+        ptrdiff_t *v1;
+        ptrdiff_t *v2;
+        struct string_diff *diff;
+        size_t capacity;
+};
+
+/* Static functions ----------------------------------------------------------*/
+
+/**
+ * @brief Returns the byte offset in the viewed string of the token 'i' of
+ * 'seq'.
+ */
+static size_t token_offset(const struct diff_seq *seq, size_t i)
+{
+        return (seq->lines ? seq->lines[i].offset : seq->start + i);
+}
+
+static int tokens_equal(const struct diff_ctx *ctx, size_t i, size_t j)
+{
+        if (!ctx->a.lines)
+                return ctx->a.value[ctx->a.start + i]
+                                == ctx->b.value[ctx->b.start + j];
+
+        const struct diff_line *la = ctx->a.lines + i;
+        const struct diff_line *lb = ctx->b.lines + j;
+        const size_t len = la[1].offset - la->offset;
+
+        return la->hash == lb->hash && len == lb[1].offset - lb->offset
+                        && memcmp(ctx->a.value + la->offset,
+                                        ctx->b.value + lb->offset, len) == 0;
+}
+
+static size_t common_prefix(const struct diff_ctx *ctx, size_t a_lo,
+                size_t a_hi, size_t b_lo, size_t b_hi)
+{
+        const size_t a_len = a_hi - a_lo;
+        const size_t b_len = b_hi - b_lo;
+        const size_t len = (a_len < b_len ? a_len : b_len);
+
+        if (!ctx->a.lines)
+                return simd_kernels.common_prefix(
+                                ctx->a.value + ctx->a.start + a_lo,
+                                ctx->b.value + ctx->b.start + b_lo, len);
+
+        size_t i = 0;
+        while (i < len && tokens_equal(ctx, a_lo + i, b_lo + i))
+                ++i;
+
+        return i;
+}
+
+static size_t common_suffix(const struct diff_ctx *ctx, size_t a_lo,
+                size_t a_hi, size_t b_lo, size_t b_hi)
+{
+        const size_t a_len = a_hi - a_lo;
+        const size_t b_len = b_hi - b_lo;
+        const size_t len = (a_len < b_len ? a_len : b_len);
+
+        if (!ctx->a.lines)
+                return simd_kernels.common_suffix(
+                                ctx->a.value + ctx->a.start + a_hi - len,
+                                ctx->b.value + ctx->b.start + b_hi - len, len);
+
+        size_t i = 0;
+        while (i < len && tokens_equal(ctx, a_hi - i - 1, b_hi - i - 1))
+                ++i;
+
+        return i;
+}
+
+/**
+ * @brief Appends an edit covering 'a_len' bytes at 'a_off' of the old string
+ * and 'b_len' bytes at 'b_off' of the new one, merging it with the previous
+ * edit when they share the same operation.
+ *
+ * @return 0 on success.
+ * @return -ENOMEM on failure.
+ */
+static int emit_bytes(struct diff_ctx *ctx, enum string_diff_op op,
+                size_t a_off, size_t a_len, size_t b_off, size_t b_len)
+{
+        struct string_diff *diff = ctx->diff;
+
+        if (a_len == 0 && b_len == 0)
+                return 0;
+
+        if (diff->count > 0 && diff->edits[diff->count - 1].op == op) {
+                struct string_edit *last = diff->edits + diff->count - 1;
+                last->a.len += a_len;
+                last->b.len += b_len;
+                return 0;
+        }
+
+        if (diff->count == ctx->capacity) {
+                const size_t capacity = ctx->capacity * 2 + 1;
+                struct string_edit *edits =
+                                realloc(diff->edits, capacity * sizeof(*edits));
+                if (!edits)
+                        return -ENOMEM;
+
+                diff->edits = edits;
+                ctx->capacity = capacity;
+        }
+
+        diff->edits[diff->count++] = (struct string_edit){
+                .op = op,
+                .a = { ctx->a.value + a_off, a_len },
+                .b = { ctx->b.value + b_off, b_len },
+        };
+        return 0;
+}
+
+/**
+ * @brief Appends an edit covering the tokens ['a_lo', 'a_hi'[ of the old
+ * string and ['b_lo', 'b_hi'[ of the new one.
+ *
+ * @return 0 on success.
+ * @return -ENOMEM on failure.
+ */
+static int emit(struct diff_ctx *ctx, enum string_diff_op op, size_t a_lo,
+                size_t a_hi, size_t b_lo, size_t b_hi)
+{
+        const size_t a_off = token_offset(&ctx->a, a_lo);
+        const size_t b_off = token_offset(&ctx->b, b_lo);
+
+        return emit_bytes(ctx, op, a_off, token_offset(&ctx->a, a_hi) - a_off,
+                        b_off, token_offset(&ctx->b, b_hi) - b_off);
+}
+
+static int diff_range(struct diff_ctx *ctx, size_t a_lo, size_t a_hi,
+                size_t b_lo, size_t b_hi);
+
+/**
+ * @brief Diffs the tokens ['a_lo', 'a_hi'[ and ['b_lo', 'b_hi'[ as two halves
+ * split at the relative position ('x', 'y').
+ *
+ * @return 0 on success.
+ * @return -ENOMEM on failure.
+ */
+static int diff_split(struct diff_ctx *ctx, size_t a_lo, size_t a_hi,
+                size_t b_lo, size_t b_hi, ptrdiff_t x, ptrdiff_t y)
+{
+        const size_t a_mid = a_lo + (size_t)x;
+        const size_t b_mid = b_lo + (size_t)y;
+
+        const int res = diff_range(ctx, a_lo, a_mid, b_lo, b_mid);
+        if (res < 0)
+                return res;
+
+        return diff_range(ctx, a_mid, a_hi, b_mid, b_hi);
+}
+
+/**
+ * @brief Finds the middle snake of the edit graph of the tokens ['a_lo',
+ * 'a_hi'[ and ['b_lo', 'b_hi'[, which must both be non-empty and start and
+ * end with differing tokens, then diffs both sides of it.
+ *
+ * @return 0 on success.
+ * @return -ENOMEM on failure.
+ */
+static int diff_bisect(struct diff_ctx *ctx, size_t a_lo, size_t a_hi,
+                size_t b_lo, size_t b_hi)
+{
+        const ptrdiff_t n = (ptrdiff_t)(a_hi - a_lo);
+        const ptrdiff_t m = (ptrdiff_t)(b_hi - b_lo);
+        const ptrdiff_t max_d = (n + m + 1) / 2;
+        const ptrdiff_t v_offset = max_d;
+        const ptrdiff_t v_length = 2 * max_d + 2;
+        const ptrdiff_t delta = n - m;
+        const int front = (delta % 2 != 0);
+        ptrdiff_t *v1 = ctx->v1;
+        ptrdiff_t *v2 = ctx->v2;
+        ptrdiff_t k1_start = 0, k1_end = 0, k2_start = 0, k2_end = 0;
+
+        for (ptrdiff_t i = 0; i < v_length; ++i)
+                v1[i] = v2[i] = -1;
+        v1[v_offset + 1] = 0;
+        v2[v_offset + 1] = 0;
+
+        for (ptrdiff_t d = 0; d < max_d; ++d) {
+                /* Walk the forward path one step */
+                for (ptrdiff_t k1 = -d + k1_start; k1 <= d - k1_end; k1 += 2) {
+                        const ptrdiff_t k1_offset = v_offset + k1;
+                        ptrdiff_t x1, y1;
+
+                        if (k1 == -d || (k1 != d && v1[k1_offset - 1]
+                                        < v1[k1_offset + 1]))
+                                x1 = v1[k1_offset + 1];
+                        else
+                                x1 = v1[k1_offset - 1] + 1;
+
+                        y1 = x1 - k1;
+                        while (x1 < n && y1 < m && tokens_equal(ctx,
+                                        a_lo + (size_t)x1, b_lo + (size_t)y1)) {
+                                ++x1;
+                                ++y1;
+                        }
+                        v1[k1_offset] = x1;
+
+                        if (x1 > n) {
+                                k1_end += 2;
+                        } else if (y1 > m) {
+                                k1_start += 2;
+                        } else if (front) {
+                                const ptrdiff_t k2_offset =
+                                                v_offset + delta - k1;
+                                if (k2_offset >= 0 && k2_offset < v_length
+                                                && v2[k2_offset] != -1
+                                                && x1 >= n - v2[k2_offset])
+                                        return diff_split(ctx, a_lo, a_hi,
+                                                        b_lo, b_hi, x1, y1);
+                        }
+                }
+
+                /* Walk the reverse path one step */
+                for (ptrdiff_t k2 = -d + k2_start; k2 <= d - k2_end; k2 += 2) {
+                        const ptrdiff_t k2_offset = v_offset + k2;
+                        ptrdiff_t x2, y2;
+
+                        if (k2 == -d || (k2 != d && v2[k2_offset - 1]
+                                        < v2[k2_offset + 1]))
+                                x2 = v2[k2_offset + 1];
+                        else
+                                x2 = v2[k2_offset - 1] + 1;
+
+                        y2 = x2 - k2;
+                        while (x2 < n && y2 < m && tokens_equal(ctx,
+                                        a_hi - (size_t)x2 - 1,
+                                        b_hi - (size_t)y2 - 1)) {
+                                ++x2;
+                                ++y2;
+                        }
+                        v2[k2_offset] = x2;
+
+                        if (x2 > n) {
+                                k2_end += 2;
+                        } else if (y2 > m) {
+                                k2_start += 2;
+                        } else if (!front) {
+                                const ptrdiff_t k1_offset =
+                                                v_offset + delta - k2;
+                                if (k1_offset < 0 || k1_offset >= v_length
+                                                || v1[k1_offset] == -1)
+                                        continue;
+
+                                const ptrdiff_t x1 = v1[k1_offset];
+                                const ptrdiff_t y1 = v_offset + x1 - k1_offset;
+                                if (x1 >= n - x2)
+                                        return diff_split(ctx, a_lo, a_hi,
+                                                        b_lo, b_hi, x1, y1);
+                        }
+                }
+        }
+
+        /* No common token at all */
+        const int res = emit(ctx, STRING_DIFF_DELETE, a_lo, a_hi, b_lo, b_lo);
+        if (res < 0)
+                return res;
+
+        return emit(ctx, STRING_DIFF_INSERT, a_hi, a_hi, b_lo, b_hi);
+}
+
+/**
+ * @brief Appends the edit script turning the tokens ['a_lo', 'a_hi'[ of the
+ * old string into the tokens ['b_lo', 'b_hi'[ of the new one.
+ *
+ * @return 0 on success.
+ * @return -ENOMEM on failure.
+ */
+static int diff_range(struct diff_ctx *ctx, size_t a_lo, size_t a_hi,
+                size_t b_lo, size_t b_hi)
+{
+        int res;
+
+        const size_t prefix = common_prefix(ctx, a_lo, a_hi, b_lo, b_hi);
+        res = emit(ctx, STRING_DIFF_EQUAL, a_lo, a_lo + prefix, b_lo,
+                        b_lo + prefix);
+        if (res < 0)
+                return res;
+
+        a_lo += prefix;
+        b_lo += prefix;
+
+        const size_t suffix = common_suffix(ctx, a_lo, a_hi, b_lo, b_hi);
+        a_hi -= suffix;
+        b_hi -= suffix;
+
+        if (a_lo == a_hi)
+                res = emit(ctx, STRING_DIFF_INSERT, a_lo, a_lo, b_lo, b_hi);
+        else if (b_lo == b_hi)
+                res = emit(ctx, STRING_DIFF_DELETE, a_lo, a_hi, b_lo, b_lo);
+        else
+                res = diff_bisect(ctx, a_lo, a_hi, b_lo, b_hi);
+
+        if (res < 0)
+                return res;
+
+        return emit(ctx, STRING_DIFF_EQUAL, a_hi, a_hi + suffix, b_hi,
+                        b_hi + suffix);
+}
+
+/**
+ * @brief Builds the line index of the 'len' bytes of 'seq' starting at
+ * 'seq->start'.
+ *
+ * @return 0 on success.
+ * @return -ENOMEM on failure.
+ */
+static int index_lines(struct diff_seq *seq, size_t len)
+{
+        const char *pos = seq->value + seq->start;
+        const char *end = pos + len;
+        size_t count = 0;
+
+        for (const char *it = pos; it < end; ++count) {
+                const char *eol = memchr(it, '\n', (size_t)(end - it));
+                it = (eol ? eol + 1 : end);
+        }
+
+        seq->lines = malloc((count + 1) * sizeof(*seq->lines));
+        if (!seq->lines)
+                return -ENOMEM;
+
+        for (size_t i = 0; i < count; ++i) {
+                uint64_t hash = FNV_OFFSET;
+
+                seq->lines[i].offset = (size_t)(pos - seq->value);
+                do {
+                        hash = (hash ^ (unsigned char)*pos) * FNV_PRIME;
+                } while (*pos++ != '\n' && pos < end);
+                seq->lines[i].hash = hash;
+        }
+
+        seq->lines[count].offset = seq->start + len;
+        seq->len = count;
+        return 0;
+}
+
+/**
+ * @brief Returns 1 if the byte 'pos' of 'value' starts a line, 0 otherwise.
+ */
+static int starts_line(const char *value, size_t pos)
+{
+        return pos == 0 || value[pos - 1] == '\n';
+}
+
+/* API -----------------------------------------------------------------------*/
+
+struct string_diff *string_diff(const struct string *a,
+                const struct string *b, enum string_diff_mode mode)
+{
+        if (!a || !b)
+                return NULL;
+
+        struct diff_ctx ctx = {
+                .a = { .value = a->value },
+                .b = { .value = b->value },
+        };
+        ctx.diff = calloc(1, sizeof(*ctx.diff));
+        if (!ctx.diff)
+                return NULL;
+
+        const size_t a_len = (size_t)string_len(a);
+        const size_t b_len = (size_t)string_len(b);
+        const size_t len = (a_len < b_len ? a_len : b_len);
+        size_t prefix = simd_kernels.common_prefix(a->value, b->value, len);
+        size_t suffix = simd_kernels.common_suffix(
+                        a->value + a_len - (len - prefix),
+                        b->value + b_len - (len - prefix), len - prefix);
+
+        if (mode == STRING_DIFF_LINES) {
+                while (prefix > 0 && a->value[prefix - 1] != '\n')
+                        --prefix;
+                while (suffix > 0 && !(starts_line(a->value, a_len - suffix)
+                                && starts_line(b->value, b_len - suffix)))
+                        --suffix;
+        }
+
+        if (emit_bytes(&ctx, STRING_DIFF_EQUAL, 0, prefix, 0, prefix) < 0)
+                goto error;
+
+        ctx.a.start = prefix;
+        ctx.b.start = prefix;
+        ctx.a.len = a_len - prefix - suffix;
+        ctx.b.len = b_len - prefix - suffix;
+
+        if (mode == STRING_DIFF_LINES) {
+                if (index_lines(&ctx.a, ctx.a.len) < 0
+                                || index_lines(&ctx.b, ctx.b.len) < 0)
+                        goto error;
+        }
+
+        const size_t v_length = (ctx.a.len + ctx.b.len + 1) / 2 * 2 + 2;
+        ctx.v1 = malloc(2 * v_length * sizeof(*ctx.v1));
+        if (!ctx.v1)
+                goto error;
+        ctx.v2 = ctx.v1 + v_length;
+
+        if (diff_range(&ctx, 0, ctx.a.len, 0, ctx.b.len) < 0)
+                goto error;
+
+        if (emit_bytes(&ctx, STRING_DIFF_EQUAL, a_len - suffix, suffix,
+                        b_len - suffix, suffix) < 0)
+                goto error;
+
+        free(ctx.v1);
+        free(ctx.a.lines);
+        free(ctx.b.lines);
+        return ctx.diff;
+
+error:
+        free(ctx.v1);
+        free(ctx.a.lines);
+        free(ctx.b.lines);
+        string_diff_destroy(ctx.diff);
+        return NULL;
+}
+
+void string_diff_destroy(struct string_diff *diff)
+{
+        if (!diff)
+                return;
+
+        free(diff->edits);
+        free(diff);
+}
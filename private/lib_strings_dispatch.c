@@ -0,0 +1,420 @@
+/**
+ * @author Maxence ROBIN
+ * @brief Internal dispatch of the vectorized kernels to the best instruction
+ * set of the running CPU.
+ *
+ * The SSE2 level is the baseline of the inline kernels of lib_strings_simd.h.
+ * The AVX2 kernels process 32 bytes at a time and hand their tail over to the
+ * baseline ones, the scalar kernels are the reference implementations.
+ */
+
+/* Includes ------------------------------------------------------------------*/
+
+#include "lib_strings.h"
+#include "lib_strings_dispatch.h"
+#include "lib_strings_simd.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SIMD_HAS_X86 1
+#else
+#define SIMD_HAS_X86 0
+#endif
+
+/* Definitions ---------------------------------------------------------------*/
+
+#define AVX2_WIDTH 32
+#define AVX2_FULL_MASK 0xffffffffU
+
+#define AVX2_KERNEL __attribute__((target("avx2")))
+
+/* Static variables ----------------------------------------------------------*/
+
+static enum simd_level dispatched_level = SIMD_LEVEL_SSE2;
+
+static const char *const level_names[] = {
+        [SIMD_LEVEL_SCALAR] = "scalar",
+        [SIMD_LEVEL_SSE2] = "sse2",
+        [SIMD_LEVEL_AVX2] = "avx2",
+};
+
+/* Static functions ----------------------------------------------------------*/
+
+/* Scalar kernels ------------------------*/
+
+static size_t scalar_common_prefix(const char *a, const char *b, size_t len)
+{
+        size_t i = 0;
+
+        while (i < len && a[i] == b[i])
+                ++i;
+
+        return i;
+}
+
+static size_t scalar_common_suffix(const char *a, const char *b, size_t len)
+{
+        size_t i = 0;
+
+        while (i < len && a[len - i - 1] == b[len - i - 1])
+                ++i;
+
+        return i;
+}
+
+static size_t scalar_find_any4(const char *src, size_t len, char a, char b,
+                char c, char d)
+{
+        for (size_t i = 0; i < len; ++i) {
+                if (src[i] == a || src[i] == b || src[i] == c || src[i] == d)
+                        return i;
+        }
+
+        return len;
+}
+
+static unsigned int scalar_scan_content(const char *src, size_t len)
+{
+        unsigned int flags = 0;
+
+        for (size_t i = 0; i < len; ++i) {
+                if ((unsigned char)src[i] > 0x7f)
+                        flags |= SIMD_CONTENT_NON_ASCII;
+                else if (src[i] == '\0')
+                        flags |= SIMD_CONTENT_NUL;
+        }
+
+        return flags;
+}
+
+static size_t scalar_ascii_prefix(const char *src, size_t len)
+{
+        size_t i = 0;
+
+        while (i < len && (unsigned char)src[i] <= 0x7f)
+                ++i;
+
+        return i;
+}
+
+static size_t scalar_count_utf8_chars(const char *src, size_t len)
+{
+        size_t count = 0;
+
+        for (size_t i = 0; i < len; ++i)
+                count += (((unsigned char)src[i] & 0xc0) != 0x80);
+
+        return count;
+}
+
+/* Baseline kernels ----------------------*/
+
+static size_t sse2_common_prefix(const char *a, const char *b, size_t len)
+{
+        return simd_common_prefix(a, b, len);
+}
+
+static size_t sse2_common_suffix(const char *a, const char *b, size_t len)
+{
+        return simd_common_suffix(a, b, len);
+}
+
+static size_t sse2_find_any4(const char *src, size_t len, char a, char b,
+                char c, char d)
+{
+        return simd_find_any4(src, len, a, b, c, d);
+}
+
+static unsigned int sse2_scan_content(const char *src, size_t len)
+{
+        return simd_scan_content(src, len);
+}
+
+static size_t sse2_ascii_prefix(const char *src, size_t len)
+{
+        return simd_ascii_prefix(src, len);
+}
+
+static size_t sse2_count_utf8_chars(const char *src, size_t len)
+{
+        return simd_count_utf8_chars(src, len);
+}
+
+static unsigned int sse2_scan_content_padded(const char *src, size_t len)
+{
+        return simd_scan_content_padded(src, len);
+}
+
+static size_t sse2_count_utf8_chars_padded(const char *src, size_t len)
+{
+        return simd_count_utf8_chars_padded(src, len);
+}
+
+/* AVX2 kernels --------------------------*/
+
+#if SIMD_HAS_X86
+
+static AVX2_KERNEL unsigned int avx2_eq_mask(const char *a, const char *b)
+{
+        const __m256i va = _mm256_loadu_si256((const __m256i *)a);
+        const __m256i vb = _mm256_loadu_si256((const __m256i *)b);
+        return (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(va, vb));
+}
+
+static AVX2_KERNEL size_t avx2_common_prefix(const char *a, const char *b,
+                size_t len)
+{
+        size_t i = 0;
+
+        for (; i + AVX2_WIDTH <= len; i += AVX2_WIDTH) {
+                const unsigned int mask = avx2_eq_mask(a + i, b + i);
+                if (mask != AVX2_FULL_MASK)
+                        return i + (size_t)__builtin_ctz(~mask);
+        }
+
+        return i + simd_common_prefix(a + i, b + i, len - i);
+}
+
+static AVX2_KERNEL size_t avx2_common_suffix(const char *a, const char *b,
+                size_t len)
+{
+        size_t i = 0;
+
+        for (; i + AVX2_WIDTH <= len; i += AVX2_WIDTH) {
+                const size_t start = len - i - AVX2_WIDTH;
+                const unsigned int mask = avx2_eq_mask(a + start, b + start);
+                if (mask != AVX2_FULL_MASK)
+                        return i + (size_t)__builtin_clz(~mask);
+        }
+
+        return i + simd_common_suffix(a, b, len - i);
+}
+
+static AVX2_KERNEL size_t avx2_find_any4(const char *src, size_t len, char a,
+                char b, char c, char d)
+{
+        const __m256i va = _mm256_set1_epi8(a);
+        const __m256i vb = _mm256_set1_epi8(b);
+        const __m256i vc = _mm256_set1_epi8(c);
+        const __m256i vd = _mm256_set1_epi8(d);
+        size_t i = 0;
+
+        for (; i + AVX2_WIDTH <= len; i += AVX2_WIDTH) {
+                const __m256i v = _mm256_loadu_si256(
+                                (const __m256i *)(src + i));
+                const __m256i eq = _mm256_or_si256(
+                                _mm256_or_si256(_mm256_cmpeq_epi8(v, va),
+                                                _mm256_cmpeq_epi8(v, vb)),
+                                _mm256_or_si256(_mm256_cmpeq_epi8(v, vc),
+                                                _mm256_cmpeq_epi8(v, vd)));
+                const unsigned int mask =
+                                (unsigned int)_mm256_movemask_epi8(eq);
+                if (mask)
+                        return i + (size_t)__builtin_ctz(mask);
+        }
+
+        return i + simd_find_any4(src + i, len - i, a, b, c, d);
+}
+
+static AVX2_KERNEL unsigned int avx2_scan_content(const char *src, size_t len)
+{
+        const __m256i zero = _mm256_setzero_si256();
+        __m256i high = zero;
+        __m256i nul = zero;
+        unsigned int flags = 0;
+        size_t i = 0;
+
+        for (; i + AVX2_WIDTH <= len; i += AVX2_WIDTH) {
+                const __m256i v = _mm256_loadu_si256(
+                                (const __m256i *)(src + i));
+                high = _mm256_or_si256(high, v);
+                nul = _mm256_or_si256(nul, _mm256_cmpeq_epi8(v, zero));
+        }
+
+        if (_mm256_movemask_epi8(high))
+                flags |= SIMD_CONTENT_NON_ASCII;
+        if (_mm256_movemask_epi8(nul))
+                flags |= SIMD_CONTENT_NUL;
+
+        return flags | simd_scan_content(src + i, len - i);
+}
+
+static AVX2_KERNEL size_t avx2_ascii_prefix(const char *src, size_t len)
+{
+        size_t i = 0;
+
+        for (; i + AVX2_WIDTH <= len; i += AVX2_WIDTH) {
+                const __m256i v = _mm256_loadu_si256(
+                                (const __m256i *)(src + i));
+                const unsigned int mask = (unsigned int)_mm256_movemask_epi8(v);
+                if (mask)
+                        return i + (size_t)__builtin_ctz(mask);
+        }
+
+        return i + simd_ascii_prefix(src + i, len - i);
+}
+
+static AVX2_KERNEL size_t avx2_count_utf8_chars(const char *src, size_t len)
+{
+        /* Continuation bytes are 0x80 to 0xbf, that is -128 to -65 signed */
+        const __m256i last_continuation = _mm256_set1_epi8(-65);
+        size_t count = 0;
+        size_t i = 0;
+
+        for (; i + AVX2_WIDTH <= len; i += AVX2_WIDTH) {
+                const __m256i v = _mm256_loadu_si256(
+                                (const __m256i *)(src + i));
+                const __m256i lead = _mm256_cmpgt_epi8(v, last_continuation);
+                count += (size_t)__builtin_popcount(
+                                (unsigned int)_mm256_movemask_epi8(lead));
+        }
+
+        return count + simd_count_utf8_chars(src + i, len - i);
+}
+
+static AVX2_KERNEL unsigned int avx2_scan_content_padded(const char *src,
+                size_t len)
+{
+        const size_t full = len - len % AVX2_WIDTH;
+
+        return avx2_scan_content(src, full)
+                        | simd_scan_content_padded(src + full, len - full);
+}
+
+static AVX2_KERNEL size_t avx2_count_utf8_chars_padded(const char *src,
+                size_t len)
+{
+        const size_t full = len - len % AVX2_WIDTH;
+
+        return avx2_count_utf8_chars(src, full)
+                        + simd_count_utf8_chars_padded(src + full, len - full);
+}
+
+#endif /* SIMD_HAS_X86 */
+
+/* Dispatch ------------------------------*/
+
+static const struct simd_kernels scalar_kernels = {
+        .common_prefix = scalar_common_prefix,
+        .common_suffix = scalar_common_suffix,
+        .find_any4 = scalar_find_any4,
+        .scan_content = scalar_scan_content,
+        .ascii_prefix = scalar_ascii_prefix,
+        .count_utf8_chars = scalar_count_utf8_chars,
+        .scan_content_padded = scalar_scan_content,
+        .count_utf8_chars_padded = scalar_count_utf8_chars,
+};
+
+static const struct simd_kernels sse2_kernels = {
+        .common_prefix = sse2_common_prefix,
+        .common_suffix = sse2_common_suffix,
+        .find_any4 = sse2_find_any4,
+        .scan_content = sse2_scan_content,
+        .ascii_prefix = sse2_ascii_prefix,
+        .count_utf8_chars = sse2_count_utf8_chars,
+        .scan_content_padded = sse2_scan_content_padded,
+        .count_utf8_chars_padded = sse2_count_utf8_chars_padded,
+};
+
+#if SIMD_HAS_X86
+static const struct simd_kernels avx2_kernels = {
+        .common_prefix = avx2_common_prefix,
+        .common_suffix = avx2_common_suffix,
+        .find_any4 = avx2_find_any4,
+        .scan_content = avx2_scan_content,
+        .ascii_prefix = avx2_ascii_prefix,
+        .count_utf8_chars = avx2_count_utf8_chars,
+        .scan_content_padded = avx2_scan_content_padded,
+        .count_utf8_chars_padded = avx2_count_utf8_chars_padded,
+};
+#endif
+
+/**
+ * @brief Returns the best level supported by the running CPU. The baseline
+ * kernels fall back to scalar code on CPUs without SSE2.
+ */
+static enum simd_level supported_level(void)
+{
+#if SIMD_HAS_X86
+        __builtin_cpu_init();
+
+        if (__builtin_cpu_supports("avx2"))
+                return SIMD_LEVEL_AVX2;
+#endif
+
+#if defined(__SSE2__)
+        return SIMD_LEVEL_SSE2;
+#else
+        return SIMD_LEVEL_SCALAR;
+#endif
+}
+
+/**
+ * @brief Returns the level forced by the STRINGS_SIMD_LEVEL environment
+ * variable, or 'level' if it is not set or names an unknown level.
+ */
+static enum simd_level requested_level(enum simd_level level)
+{
+        const char *name = getenv("STRINGS_SIMD_LEVEL");
+        if (!name)
+                return level;
+
+        for (size_t i = 0; i < sizeof(level_names) / sizeof(*level_names);
+                        ++i) {
+                if (strcmp(name, level_names[i]) == 0)
+                        return (enum simd_level)i;
+        }
+
+        return level;
+}
+
+/* API -----------------------------------------------------------------------*/
+
+/* Valid before the dispatch runs, for the constructors of other libraries */
+struct simd_kernels simd_kernels = {
+        .common_prefix = sse2_common_prefix,
+        .common_suffix = sse2_common_suffix,
+        .find_any4 = sse2_find_any4,
+        .scan_content = sse2_scan_content,
+        .ascii_prefix = sse2_ascii_prefix,
+        .count_utf8_chars = sse2_count_utf8_chars,
+        .scan_content_padded = sse2_scan_content_padded,
+        .count_utf8_chars_padded = sse2_count_utf8_chars_padded,
+};
+
+/**
+ * @brief Fills the kernels table once, when the library is loaded. A forced
+ * level is never raised above what the CPU supports.
+ */
+__attribute__((constructor)) static void dispatch_kernels(void)
+{
+        const enum simd_level supported = supported_level();
+        enum simd_level level = requested_level(supported);
+
+        if (level > supported)
+                level = supported;
+
+        switch (level) {
+        case SIMD_LEVEL_SCALAR:
+                simd_kernels = scalar_kernels;
+                break;
+#if SIMD_HAS_X86
+        case SIMD_LEVEL_AVX2:
+                simd_kernels = avx2_kernels;
+                break;
+#endif
+        default:
+                simd_kernels = sse2_kernels;
+                break;
+        }
+
+        dispatched_level = level;
+}
+
+const char *string_simd_level(void)
+{
+        return level_names[dispatched_level];
+}
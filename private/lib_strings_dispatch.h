@@ -0,0 +1,47 @@
+/**
+ * @author Maxence ROBIN
+ * @brief Internal dispatch of the vectorized kernels to the best instruction
+ * set of the running CPU.
+ *
+ * The table is filled once when the library is loaded, kernels are then
+ * called through it without any per-call check. The STRINGS_SIMD_LEVEL
+ * environment variable forces a lower level, for testing and benchmarking.
+ */
+
+#ifndef LIB_STRINGS_DISPATCH_H
+#define LIB_STRINGS_DISPATCH_H
+
+/* Includes ------------------------------------------------------------------*/
+
+#include <stddef.h>
+
+/* Definitions ---------------------------------------------------------------*/
+
+enum simd_level {
+    SIMD_LEVEL_SCALAR,
+    SIMD_LEVEL_SSE2,
+    SIMD_LEVEL_AVX2
+};
+
+/**
+ * @brief The vectorized kernels, see lib_strings_simd.h for their behavior.
+ */
+struct simd_kernels {
+    size_t (*common_prefix)(const char *a, const char *b, size_t len);
+    size_t (*common_suffix)(const char *a, const char *b, size_t len);
+    size_t (*find_any4)(const char *src, size_t len, char a, char b, char c,
+            char d);
+    unsigned int (*scan_content)(const char *src, size_t len);
+    size_t (*ascii_prefix)(const char *src, size_t len);
+    size_t (*count_utf8_chars)(const char *src, size_t len);
+
+    /* Only for string values, which are padded past their capacity */
+    unsigned int (*scan_content_padded)(const char *src, size_t len);
+    size_t (*count_utf8_chars_padded)(const char *src, size_t len);
+};
+
+/* API -----------------------------------------------------------------------*/
+
+extern struct simd_kernels simd_kernels __attribute__((visibility("hidden")));
+
+#endif /* LIB_STRINGS_DISPATCH_H */
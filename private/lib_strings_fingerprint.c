@@ -0,0 +1,306 @@
+/**
+ * @author Maxence ROBIN
+ * @brief Provides MinHash and SimHash fingerprints for near-duplicate
+ * detection.
+ */
+
+/* Includes ------------------------------------------------------------------*/
+
+#include "lib_strings_fingerprint.h"
+#include "lib_strings_simd.h"
+
+#include <errno.h>
+#include <stdlib.h>
+
+/* Definitions ---------------------------------------------------------------*/
+
+#define SHINGLE_BASE 0x100000001b3ULL
+#define FAMILY_SEED 0x5bd1e9955bd1e995ULL
+#define SIMHASH_BITS 64
+
+/**
+ * @brief Rolling hash over the shingles of a char array.
+ */
+struct shingles {
+        const unsigned char *out;
+        const unsigned char *in;
+        const unsigned char *end;
+        uint64_t hash;
+        uint64_t base_pow;
+        int pending;
+};
+
+/**
+ * @brief The MinHash hash family h_i(x) = mul[i] * x + add[i], with an odd
+ * 'mul[i]'. Arrays are padded to a multiple of the vector lanes count and
+ * 'sig' holds the signature being reduced.
+ */
+struct minhash_family {
+        uint32_t *mul;
+        uint32_t *add;
+        uint32_t *sig;
+        size_t padded;
+};
+
+/* Static functions ----------------------------------------------------------*/
+
+static uint64_t splitmix64(uint64_t *state)
+{
+        uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+}
+
+/**
+ * @brief Mixes the raw polynomial hash of a shingle so that every output bit
+ * depends on every input byte.
+ */
+static uint64_t mix64(uint64_t h)
+{
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ULL;
+        return h ^ (h >> 33);
+}
+
+/**
+ * @brief Prepares 'it' to iterate over the 'k' bytes long shingles of the
+ * char array 'src' of length 'len'.
+ */
+static void shingles_init(struct shingles *it, const char *src, size_t len,
+                size_t k)
+{
+        const size_t width = (len < k ? len : k);
+
+        it->out = (const unsigned char *)src;
+        it->in = it->out + width;
+        it->end = it->out + len;
+        it->hash = 0;
+        it->base_pow = 1;
+        it->pending = (len > 0);
+
+        for (size_t i = 0; i < width; ++i) {
+                it->hash = it->hash * SHINGLE_BASE + it->out[i];
+                if (i > 0)
+                        it->base_pow *= SHINGLE_BASE;
+        }
+}
+
+/**
+ * @brief Writes the hash of the next shingle of 'it' into 'hash'.
+ *
+ * @return 1 if a shingle was hashed.
+ * @return 0 if there are no shingles left.
+ */
+static int shingles_next(struct shingles *it, uint64_t *hash)
+{
+        if (it->pending) {
+                it->pending = 0;
+        } else {
+                if (it->in == it->end)
+                        return 0;
+
+                it->hash -= *it->out++ * it->base_pow;
+                it->hash = it->hash * SHINGLE_BASE + *it->in++;
+        }
+
+        *hash = mix64(it->hash);
+        return 1;
+}
+
+/**
+ * @brief Allocates and seeds a hash family of 'num_hashes' functions.
+ *
+ * @return 0 on success.
+ * @return -ENOMEM if its size overflows or on failure.
+ */
+static int minhash_family_init(struct minhash_family *family,
+                size_t num_hashes)
+{
+        if (num_hashes > SIZE_MAX / (3 * sizeof(uint32_t)) - SIMD_U32_LANES)
+                return -ENOMEM;
+
+        const size_t padded = (num_hashes + SIMD_U32_LANES - 1)
+                        / SIMD_U32_LANES * SIMD_U32_LANES;
+        uint32_t *buf = malloc(3 * padded * sizeof(*buf));
+        if (!buf)
+                return -ENOMEM;
+
+        family->mul = buf;
+        family->add = buf + padded;
+        family->sig = buf + 2 * padded;
+        family->padded = padded;
+
+        uint64_t state = FAMILY_SEED;
+        for (size_t i = 0; i < padded; ++i) {
+                const uint64_t r = splitmix64(&state);
+                family->mul[i] = (uint32_t)r | 1;
+                family->add[i] = (uint32_t)(r >> 32);
+        }
+
+        return 0;
+}
+
+static void minhash_family_release(struct minhash_family *family)
+{
+        free(family->mul);
+}
+
+/**
+ * @brief Reduces the signature of 'family' with the shingle hash 'x', every
+ * hash function being evaluated and min-reduced one vector at a time.
+ */
+static void minhash_update(struct minhash_family *family, uint32_t x)
+{
+        const simd_u32 vx = (simd_u32){0} + x;
+
+        for (size_t i = 0; i < family->padded; i += SIMD_U32_LANES) {
+                const simd_u32 h = simd_load_u32(family->mul + i) * vx
+                                + simd_load_u32(family->add + i);
+                const simd_u32 sig = simd_load_u32(family->sig + i);
+
+                simd_store_u32(family->sig + i, simd_min_u32(sig, h));
+        }
+}
+
+/**
+ * @brief Computes the MinHash signature of 'str' with 'family' into 'out'.
+ */
+static void minhash_string(struct minhash_family *family,
+                const struct string *str, size_t k, size_t num_hashes,
+                uint32_t *out)
+{
+        struct shingles it;
+        uint64_t hash;
+
+        for (size_t i = 0; i < family->padded; ++i)
+                family->sig[i] = UINT32_MAX;
+
+        shingles_init(&it, str->value, (size_t)string_len(str), k);
+        while (shingles_next(&it, &hash))
+                minhash_update(family, (uint32_t)(hash >> 32));
+
+        memcpy(out, family->sig, num_hashes * sizeof(*out));
+}
+
+/**
+ * @brief Computes the SimHash of 'str' over its 'k' bytes long shingles.
+ *
+ * Each bit of each shingle hash votes for the matching bit of the result, 32
+ * bits being counted at once per vector of counters.
+ */
+static uint64_t simhash_string(const struct string *str, size_t k)
+{
+        simd_u32 counters[SIMHASH_BITS / SIMD_U32_LANES] = {0};
+        simd_u32 shifts;
+        struct shingles it;
+        uint64_t hash;
+        size_t shingles_count = 0;
+
+        for (size_t lane = 0; lane < SIMD_U32_LANES; ++lane)
+                shifts[lane] = (uint32_t)lane;
+
+        shingles_init(&it, str->value, (size_t)string_len(str), k);
+        while (shingles_next(&it, &hash)) {
+                const simd_u32 lo = (simd_u32){0} + (uint32_t)hash;
+                const simd_u32 hi = (simd_u32){0} + (uint32_t)(hash >> 32);
+                const size_t half = SIMHASH_BITS / 2 / SIMD_U32_LANES;
+
+                for (size_t i = 0; i < half; ++i) {
+                        const simd_u32 shift =
+                                        shifts + (uint32_t)(i * SIMD_U32_LANES);
+                        counters[i] += (lo >> shift) & 1;
+                        counters[half + i] += (hi >> shift) & 1;
+                }
+                ++shingles_count;
+        }
+
+        /* A bit is set when more than half of the shingles voted for it */
+        uint64_t result = 0;
+        for (size_t bit = 0; bit < SIMHASH_BITS; ++bit) {
+                const size_t lane = bit % SIMD_U32_LANES;
+                const uint32_t votes = counters[bit / SIMD_U32_LANES][lane];
+                if (2 * (size_t)votes > shingles_count)
+                        result |= 1ULL << bit;
+        }
+
+        return result;
+}
+
+/* API -----------------------------------------------------------------------*/
+
+int string_minhash(const struct string *str, size_t k, size_t num_hashes,
+                uint32_t *out)
+{
+        return string_minhash_many(&str, 1, k, num_hashes, out);
+}
+
+int string_minhash_many(const struct string *const *strs, size_t n, size_t k,
+                size_t num_hashes, uint32_t *out)
+{
+        if (!strs || !out || k == 0 || num_hashes == 0)
+                return -EINVAL;
+
+        /* 'out' could not hold the signatures of all the strings */
+        if (n > SIZE_MAX / sizeof(*out) / num_hashes)
+                return -EINVAL;
+
+        for (size_t i = 0; i < n; ++i) {
+                if (!strs[i])
+                        return -EINVAL;
+        }
+
+        struct minhash_family family;
+        const int res = minhash_family_init(&family, num_hashes);
+        if (res < 0)
+                return res;
+
+        for (size_t i = 0; i < n; ++i)
+                minhash_string(&family, strs[i], k, num_hashes,
+                                out + i * num_hashes);
+
+        minhash_family_release(&family);
+        return 0;
+}
+
+double string_minhash_similarity(const uint32_t *a, const uint32_t *b,
+                size_t num_hashes)
+{
+        if (!a || !b || num_hashes == 0)
+                return 0.0;
+
+        size_t equal = 0;
+        for (size_t i = 0; i < num_hashes; ++i)
+                equal += (a[i] == b[i]);
+
+        return (double)equal / (double)num_hashes;
+}
+
+int string_simhash(const struct string *str, size_t k, uint64_t *out)
+{
+        return string_simhash_many(&str, 1, k, out);
+}
+
+int string_simhash_many(const struct string *const *strs, size_t n, size_t k,
+                uint64_t *out)
+{
+        if (!strs || !out || k == 0)
+                return -EINVAL;
+
+        for (size_t i = 0; i < n; ++i) {
+                if (!strs[i])
+                        return -EINVAL;
+        }
+
+        for (size_t i = 0; i < n; ++i)
+                out[i] = simhash_string(strs[i], k);
+
+        return 0;
+}
+
+unsigned int string_simhash_distance(uint64_t a, uint64_t b)
+{
+        return (unsigned int)__builtin_popcountll(a ^ b);
+}
@@ -0,0 +1,245 @@
+/**
+ * @author Maxence ROBIN
+ * @brief Provides direct output of strings to file descriptors and streams.
+ */
+
+/* Includes ------------------------------------------------------------------*/
+
+#define _GNU_SOURCE
+
+#include "lib_strings_io.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+/* Definitions ---------------------------------------------------------------*/
+
+#ifndef IO_BUFFER_SIZE
+#define IO_BUFFER_SIZE (16 * 1024)
+#endif
+
+struct io_buffer {
+        int fd;
+        size_t used;
+        char data[IO_BUFFER_SIZE];
+};
+
+/* Static variables ----------------------------------------------------------*/
+
+static _Thread_local struct io_buffer *thread_buffer;
+static pthread_key_t buffer_key;
+static pthread_once_t buffer_key_once = PTHREAD_ONCE_INIT;
+static int buffer_key_valid;
+
+/* Static functions ----------------------------------------------------------*/
+
+/**
+ * @brief Writes the 'count' buffers of 'iov' to 'fd', resuming interrupted
+ * and partial writes. 'iov' is consumed.
+ *
+ * @return 0 on success.
+ * @return A negative errno on failure.
+ */
+static int write_all(int fd, struct iovec *iov, int count)
+{
+        while (count > 0) {
+                if (iov->iov_len == 0) {
+                        ++iov;
+                        --count;
+                        continue;
+                }
+
+                ssize_t res = writev(fd, iov, count);
+                if (res < 0) {
+                        if (errno == EINTR)
+                                continue;
+
+                        return -errno;
+                }
+
+                for (; count > 0 && (size_t)res >= iov->iov_len; --count) {
+                        res -= (ssize_t)iov->iov_len;
+                        ++iov;
+                }
+
+                if (count > 0) {
+                        iov->iov_base = (char *)iov->iov_base + res;
+                        iov->iov_len -= (size_t)res;
+                }
+        }
+
+        return 0;
+}
+
+/**
+ * @brief Writes the pending output of 'buffer' out, it is dropped on failure.
+ *
+ * @return 0 on success.
+ * @return A negative errno on failure.
+ */
+static int flush_buffer(struct io_buffer *buffer)
+{
+        struct iovec iov = {buffer->data, buffer->used};
+
+        buffer->used = 0;
+        return write_all(buffer->fd, &iov, 1);
+}
+
+/**
+ * @brief Flushes and destroys the buffer 'arg' of an exiting thread.
+ */
+static void destroy_buffer(void *arg)
+{
+        struct io_buffer *buffer = arg;
+
+        flush_buffer(buffer);
+        free(buffer);
+        thread_buffer = NULL;
+}
+
+/**
+ * @brief Flushes the buffer of the thread exiting the process, which gets no
+ * call to the destructor of its key.
+ */
+static void flush_at_exit(void)
+{
+        if (thread_buffer)
+                flush_buffer(thread_buffer);
+}
+
+static void create_buffer_key(void)
+{
+        buffer_key_valid = (pthread_key_create(&buffer_key,
+                        destroy_buffer) == 0);
+        if (buffer_key_valid)
+                atexit(flush_at_exit);
+}
+
+/**
+ * @brief Returns the buffer of the calling thread, creating it if needed.
+ *
+ * @return Pointer to the buffer on success.
+ * @return NULL on failure.
+ */
+static struct io_buffer *get_buffer(void)
+{
+        if (thread_buffer)
+                return thread_buffer;
+
+        pthread_once(&buffer_key_once, create_buffer_key);
+        if (!buffer_key_valid)
+                return NULL;
+
+        struct io_buffer *buffer = malloc(sizeof(*buffer));
+        if (!buffer)
+                return NULL;
+
+        if (pthread_setspecific(buffer_key, buffer) != 0) {
+                free(buffer);
+                return NULL;
+        }
+
+        buffer->fd = -1;
+        buffer->used = 0;
+        thread_buffer = buffer;
+        return buffer;
+}
+
+/* API -----------------------------------------------------------------------*/
+
+ssize_t string_dprintf_buffered(int fd, const char *format, ...)
+{
+        if (fd < 0 || !format)
+                return -EINVAL;
+
+        struct io_buffer *buffer = get_buffer();
+        if (!buffer)
+                return -ENOMEM;
+
+        int res = 0;
+        if (buffer->used && buffer->fd != fd)
+                res = flush_buffer(buffer);
+
+        buffer->fd = fd;
+        if (res < 0)
+                return res;
+
+        va_list args;
+        va_start(args, format);
+        const size_t left = IO_BUFFER_SIZE - buffer->used;
+        const int len = vsnprintf(buffer->data + buffer->used, left, format,
+                        args);
+        va_end(args);
+
+        if (len < 0)
+                return -EOVERFLOW;
+
+        /* Output fitting the room left is already in place */
+        if ((size_t)len < left) {
+                buffer->used += (size_t)len;
+                return len;
+        }
+
+        res = flush_buffer(buffer);
+        if (res < 0)
+                return res;
+
+        va_start(args, format);
+        if ((size_t)len < IO_BUFFER_SIZE) {
+                vsnprintf(buffer->data, IO_BUFFER_SIZE, format, args);
+                buffer->used = (size_t)len;
+        } else if (vdprintf(fd, format, args) < 0) {
+                res = -errno;
+        }
+        va_end(args);
+
+        return (res < 0 ? res : len);
+}
+
+int string_flush_buffered(void)
+{
+        if (!thread_buffer)
+                return 0;
+
+        return flush_buffer(thread_buffer);
+}
+
+ssize_t string_write(int fd, const struct string *str)
+{
+        if (fd < 0 || !str)
+                return -EINVAL;
+
+        const ssize_t len = string_len(str);
+        struct io_buffer *buffer = thread_buffer;
+        struct iovec iov[2];
+        int count = 0;
+
+        /* The pending output to 'fd' goes first, in the same call */
+        if (buffer && buffer->used && buffer->fd == fd) {
+                iov[count].iov_base = buffer->data;
+                iov[count++].iov_len = buffer->used;
+                buffer->used = 0;
+        }
+
+        iov[count].iov_base = str->value;
+        iov[count++].iov_len = (size_t)len;
+
+        const int res = write_all(fd, iov, count);
+        return (res < 0 ? res : len);
+}
+
+ssize_t string_fwrite(FILE *stream, const struct string *str)
+{
+        if (!stream || !str)
+                return -EINVAL;
+
+        const ssize_t len = string_len(str);
+        if (fwrite(str->value, 1, (size_t)len, stream) != (size_t)len)
+                return -EIO;
+
+        return len;
+}
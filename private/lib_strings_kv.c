@@ -0,0 +1,210 @@
+/**
+ * @author Maxence ROBIN
+ * @brief Provides zero-copy parsers of key/value pairs such as query strings
+ * and header blocks.
+ */
+
+/* Includes ------------------------------------------------------------------*/
+
+#include "lib_strings_kv.h"
+#include "lib_strings_dispatch.h"
+#include "lib_strings_simd.h"
+
+#include <errno.h>
+
+/* Definitions ---------------------------------------------------------------*/
+
+#define QUERY_PAIR_SEP '&'
+#define QUERY_KV_SEP '='
+#define HEADERS_PAIR_SEP '\n'
+#define HEADERS_KV_SEP ':'
+
+/* Static functions ----------------------------------------------------------*/
+
+/**
+ * @brief Splits the next pair of 'it' into 'kv'. Escape characters are only
+ * looked for if 'escapes' is set.
+ *
+ * This is always inlined with constant separators, each format getting a
+ * parsing loop specialized for its own separators around the dispatched
+ * search kernel.
+ *
+ * @warning 'it' must not be at its end.
+ */
+static inline __attribute__((always_inline)) void next_pair(
+                struct string_kv_iter *it, struct string_kv *kv,
+                const char pair_sep, const char kv_sep, const int escapes)
+{
+        const char *start = it->pos;
+        const char *pos = start;
+        const char *key_end = NULL;
+        unsigned int escaped = 0;
+
+        for (;;) {
+                const size_t len = (size_t)(it->end - pos);
+                if (escapes)
+                        pos += simd_kernels.find_any4(pos, len, pair_sep,
+                                        kv_sep, '%', '+');
+                else
+                        pos += simd_kernels.find_any4(pos, len, pair_sep,
+                                        kv_sep, pair_sep, kv_sep);
+
+                if (pos == it->end || *pos == pair_sep)
+                        break;
+
+                if (*pos != kv_sep)
+                        escaped |= (key_end ? STRING_KV_VALUE_ESCAPED
+                                        : STRING_KV_KEY_ESCAPED);
+                else if (!key_end)
+                        key_end = pos;
+
+                ++pos;
+        }
+
+        it->pos = (pos == it->end ? pos : pos + 1);
+        kv->escaped = escaped;
+
+        if (key_end) {
+                kv->key = (struct string_view){
+                        start, (size_t)(key_end - start) };
+                kv->value = (struct string_view){
+                        key_end + 1, (size_t)(pos - key_end - 1) };
+        } else {
+                kv->key = (struct string_view){ start, (size_t)(pos - start) };
+                kv->value = (struct string_view){ pos, 0 };
+        }
+}
+
+/**
+ * @brief Returns 1 if the pair 'kv' had a key/value separator, 0 otherwise.
+ */
+static int has_kv_sep(const struct string_kv *kv)
+{
+        return kv->value.value != kv->key.value + kv->key.len;
+}
+
+static int is_blank(char c)
+{
+        return c == ' ' || c == '\t';
+}
+
+static struct string_view trim_blanks(struct string_view view)
+{
+        while (view.len > 0 && is_blank(view.value[0])) {
+                ++view.value;
+                --view.len;
+        }
+
+        while (view.len > 0 && is_blank(view.value[view.len - 1]))
+                --view.len;
+
+        return view;
+}
+
+static int hex_value(char c)
+{
+        if (c >= '0' && c <= '9')
+                return c - '0';
+        if (c >= 'a' && c <= 'f')
+                return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F')
+                return c - 'A' + 10;
+
+        return -1;
+}
+
+/* API -----------------------------------------------------------------------*/
+
+int string_kv_init(struct string_kv_iter *it, const struct string *str)
+{
+        if (!it || !str)
+                return -EINVAL;
+
+        it->pos = str->value;
+        it->end = str->value + string_len(str);
+        return 0;
+}
+
+int string_query_next(struct string_kv_iter *it, struct string_kv *kv)
+{
+        if (!it || !kv)
+                return -EINVAL;
+
+        while (it->pos < it->end) {
+                next_pair(it, kv, QUERY_PAIR_SEP, QUERY_KV_SEP, 1);
+                if (kv->key.len > 0 || has_kv_sep(kv))
+                        return 1;
+        }
+
+        return 0;
+}
+
+int string_headers_next(struct string_kv_iter *it, struct string_kv *kv)
+{
+        if (!it || !kv)
+                return -EINVAL;
+
+        if (it->pos >= it->end)
+                return 0;
+
+        next_pair(it, kv, HEADERS_PAIR_SEP, HEADERS_KV_SEP, 0);
+
+        /* The line ends with the value, or with the key if there is no ':' */
+        const int has_sep = has_kv_sep(kv);
+        struct string_view *last = (has_sep ? &kv->value : &kv->key);
+        if (last->len > 0 && last->value[last->len - 1] == '\r')
+                --last->len;
+
+        if (!has_sep && kv->key.len == 0) {
+                it->pos = it->end;
+                return 0;
+        }
+
+        kv->key = trim_blanks(kv->key);
+        kv->value = trim_blanks(kv->value);
+        return 1;
+}
+
+int string_query_decode(struct string_view src, struct string *scratch,
+                struct string_view *out)
+{
+        if (!scratch || !out || (!src.value && src.len > 0))
+                return -EINVAL;
+        if (string_is_frozen(scratch))
+                return -EPERM;
+
+        const size_t first = simd_kernels.find_any4(src.value, src.len, '%',
+                        '+', '%', '+');
+        if (first == src.len) {
+                *out = src;
+                return 0;
+        }
+
+        const int res = string_resize(scratch, src.len);
+        if (res < 0)
+                return res;
+
+        char *dest = scratch->value;
+        size_t len = first;
+        memcpy(dest, src.value, first);
+
+        for (size_t i = first; i < src.len; ++i) {
+                const char c = src.value[i];
+
+                if (c == '+') {
+                        dest[len++] = ' ';
+                } else if (c == '%' && i + 2 < src.len
+                                && hex_value(src.value[i + 1]) >= 0
+                                && hex_value(src.value[i + 2]) >= 0) {
+                        dest[len++] = (char)(hex_value(src.value[i + 1]) << 4
+                                        | hex_value(src.value[i + 2]));
+                        i += 2;
+                } else {
+                        dest[len++] = c;
+                }
+        }
+
+        string_resize(scratch, len);
+        *out = (struct string_view){ scratch->value, len };
+        return 0;
+}
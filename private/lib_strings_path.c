@@ -0,0 +1,195 @@
+/**
+ * @author Maxence ROBIN
+ * @brief Provides allocation-free manipulation of '/' separated paths.
+ */
+
+/* Includes ------------------------------------------------------------------*/
+
+#include "lib_strings_path.h"
+
+#include <errno.h>
+#include <string.h>
+
+/* Static functions ----------------------------------------------------------*/
+
+/**
+ * @brief Returns the length of the path 'value' of length 'len' without its
+ * trailing '/', keeping at least one character.
+ */
+static size_t strip_trailing_slashes(const char *value, size_t len)
+{
+        while (len > 1 && value[len - 1] == '/')
+                --len;
+
+        return len;
+}
+
+/**
+ * @brief Returns the position of the last '/' of the char array 'value' of
+ * length 'len', or 'len' if there is none.
+ */
+static size_t last_slash(const char *value, size_t len)
+{
+        for (size_t i = len; i > 0; --i) {
+                if (value[i - 1] == '/')
+                        return i - 1;
+        }
+
+        return len;
+}
+
+/**
+ * @brief Returns 1 if the last component of the normalized path written in
+ * 'value' between 'floor' and 'end' is '..', 0 otherwise.
+ */
+static int ends_with_dotdot(const char *value, size_t floor, size_t end)
+{
+        return end - floor >= 2 && value[end - 1] == '.'
+                        && value[end - 2] == '.'
+                        && (end - 2 == floor || value[end - 3] == '/');
+}
+
+/**
+ * @brief Joins the path char array 'src' of length 'len' to 'dest'.
+ *
+ * @return 0 on success.
+ * @return -ENOMEM on failure.
+ */
+static int path_join(struct string *dest, const char *src, size_t len)
+{
+        const size_t cur_len = (size_t)string_len(dest);
+
+        if (cur_len == 0 || (len > 0 && src[0] == '/'))
+                return string_copy_v(dest, src, len);
+
+        const int slash = (dest->value[cur_len - 1] != '/');
+        const int res = string_resize(dest, cur_len + slash + len);
+        if (res < 0)
+                return res;
+
+        if (slash)
+                dest->value[cur_len] = '/';
+
+        memcpy(dest->value + cur_len + slash, src, len);
+        return 0;
+}
+
+/* API -----------------------------------------------------------------------*/
+
+int string_path_join(struct string *dest, const struct string *src)
+{
+        if (!dest || !src || dest == src)
+                return -EINVAL;
+
+        return path_join(dest, src->value, (size_t)string_len(src));
+}
+
+int string_path_join_c(struct string *dest, const char *src)
+{
+        if (!dest || !src)
+                return -EINVAL;
+
+        return path_join(dest, src, strlen(src));
+}
+
+int string_path_join_v(struct string *dest, const char *src, size_t len)
+{
+        if (!dest || !src)
+                return -EINVAL;
+
+        return path_join(dest, src, len);
+}
+
+int string_path_normalize(struct string *str)
+{
+        if (!str)
+                return -EINVAL;
+
+        /* The value is rewritten in place before its final resize */
+        if (string_is_frozen(str))
+                return -EPERM;
+
+        char *value = str->value;
+        const size_t len = (size_t)string_len(str);
+        const size_t floor = (len > 0 && value[0] == '/');
+        size_t r = floor;
+        size_t w = floor;
+
+        /* The output never gets ahead of the input, both share the buffer */
+        while (r < len) {
+                while (r < len && value[r] == '/')
+                        ++r;
+                if (r == len)
+                        break;
+
+                const size_t start = r;
+                while (r < len && value[r] != '/')
+                        ++r;
+
+                const size_t seg_len = r - start;
+                if (seg_len == 1 && value[start] == '.')
+                        continue;
+
+                if (seg_len == 2 && value[start] == '.'
+                                && value[start + 1] == '.') {
+                        if (w > floor && !ends_with_dotdot(value, floor, w)) {
+                                const size_t out_len = w - floor;
+                                const size_t slash = last_slash(value + floor,
+                                                out_len);
+                                w = floor + (slash == out_len ? 0 : slash);
+                                continue;
+                        }
+                        if (floor)
+                                continue;
+                }
+
+                if (w > floor)
+                        value[w++] = '/';
+
+                memmove(value + w, value + start, seg_len);
+                w += seg_len;
+        }
+
+        if (w == 0)
+                return string_copy_v(str, ".", 1);
+
+        return string_resize(str, w);
+}
+
+struct string_view string_path_dirname(const struct string *str)
+{
+        if (!str)
+                return (struct string_view){ NULL, 0 };
+
+        const char *value = str->value;
+        const size_t len =
+                        strip_trailing_slashes(value, (size_t)string_len(str));
+        size_t end = last_slash(value, len);
+
+        if (end == len)
+                return (struct string_view){ ".", 1 };
+
+        while (end > 0 && value[end - 1] == '/')
+                --end;
+
+        return (struct string_view){ value, (end > 0 ? end : 1) };
+}
+
+struct string_view string_path_basename(const struct string *str)
+{
+        if (!str)
+                return (struct string_view){ NULL, 0 };
+
+        const char *value = str->value;
+        const size_t len =
+                        strip_trailing_slashes(value, (size_t)string_len(str));
+        const size_t slash = last_slash(value, len);
+
+        if (slash == len)
+                return (struct string_view){ value, len };
+
+        if (len == 1)
+                return (struct string_view){ value, 1 };
+
+        return (struct string_view){ value + slash + 1, len - slash - 1 };
+}
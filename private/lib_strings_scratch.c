@@ -0,0 +1,172 @@
+/**
+ * @author Maxence ROBIN
+ * @brief Provides per-thread scratch strings for temporaries.
+ */
+
+/* Includes ------------------------------------------------------------------*/
+
+#include "lib_strings_scratch.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+
+/* Definitions ---------------------------------------------------------------*/
+
+#ifndef SCRATCH_SLOTS
+#define SCRATCH_SLOTS 8
+#endif
+
+#ifndef SCRATCH_INITIAL_CAPACITY
+#define SCRATCH_INITIAL_CAPACITY 256
+#endif
+
+#ifndef SCRATCH_MAX_CAPACITY
+#define SCRATCH_MAX_CAPACITY (64 * 1024)
+#endif
+
+struct scratch_slot {
+        struct string *str;
+        int in_use;
+};
+
+struct scratch_ring {
+        struct scratch_slot slots[SCRATCH_SLOTS];
+};
+
+/* Static variables ----------------------------------------------------------*/
+
+static _Thread_local struct scratch_ring *thread_ring;
+static pthread_key_t ring_key;
+static pthread_once_t ring_key_once = PTHREAD_ONCE_INIT;
+static int ring_key_valid;
+
+/* Static functions ----------------------------------------------------------*/
+
+/**
+ * @brief Destroys the ring 'arg' of an exiting thread.
+ */
+static void destroy_ring(void *arg)
+{
+        struct scratch_ring *ring = arg;
+
+        for (size_t i = 0; i < SCRATCH_SLOTS; ++i)
+                string_destroy(ring->slots[i].str);
+
+        free(ring);
+        thread_ring = NULL;
+}
+
+static void create_ring_key(void)
+{
+        ring_key_valid = (pthread_key_create(&ring_key, destroy_ring) == 0);
+}
+
+/**
+ * @brief Returns the ring of the calling thread, creating it if needed.
+ *
+ * @return Pointer to the ring on success.
+ * @return NULL on failure.
+ */
+static struct scratch_ring *get_ring(void)
+{
+        if (thread_ring)
+                return thread_ring;
+
+        pthread_once(&ring_key_once, create_ring_key);
+        if (!ring_key_valid)
+                return NULL;
+
+        struct scratch_ring *ring = calloc(1, sizeof(*ring));
+        if (!ring)
+                return NULL;
+
+        if (pthread_setspecific(ring_key, ring) != 0) {
+                free(ring);
+                return NULL;
+        }
+
+        thread_ring = ring;
+        return ring;
+}
+
+/**
+ * @brief Creates an empty string of SCRATCH_INITIAL_CAPACITY bytes.
+ *
+ * @return Pointer to the new string on success.
+ * @return NULL on failure.
+ */
+static struct string *create_scratch(void)
+{
+        struct string *str = string_empty();
+        if (!str)
+                return NULL;
+
+        if (string_reserve(str, SCRATCH_INITIAL_CAPACITY) < 0) {
+                string_destroy(str);
+                return NULL;
+        }
+
+        return str;
+}
+
+/* API -----------------------------------------------------------------------*/
+
+struct string *string_scratch_acquire(void)
+{
+        struct scratch_ring *ring = get_ring();
+        if (!ring)
+                return create_scratch();
+
+        for (size_t i = 0; i < SCRATCH_SLOTS; ++i) {
+                struct scratch_slot *slot = ring->slots + i;
+                if (slot->in_use)
+                        continue;
+
+                if (!slot->str) {
+                        slot->str = create_scratch();
+                        if (!slot->str)
+                                return NULL;
+                }
+
+                slot->in_use = 1;
+                return slot->str;
+        }
+
+        /* The ring is exhausted by nested acquisitions */
+        return create_scratch();
+}
+
+void string_scratch_release(struct string *str)
+{
+        if (!str)
+                return;
+
+        struct scratch_ring *ring = thread_ring;
+        for (size_t i = 0; ring && i < SCRATCH_SLOTS; ++i) {
+                struct scratch_slot *slot = ring->slots + i;
+                if (slot->str != str)
+                        continue;
+
+                /* A frozen scratch can't be reused, a new one replaces it */
+                if (string_is_frozen(str)) {
+                        string_destroy_frozen(str);
+                        slot->str = NULL;
+                        slot->in_use = 0;
+                        return;
+                }
+
+                string_clear(str);
+                if (string_capacity(str) > SCRATCH_MAX_CAPACITY) {
+                        string_fit(str);
+                        string_reserve(str, SCRATCH_INITIAL_CAPACITY);
+                }
+
+                slot->in_use = 0;
+                return;
+        }
+
+        if (string_is_frozen(str))
+                string_destroy_frozen(str);
+        else
+                string_destroy(str);
+}
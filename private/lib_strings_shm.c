@@ -0,0 +1,509 @@
+/**
+ * @author Maxence ROBIN
+ * @brief Provides a pool of strings in shared memory, read in place by the
+ * processes of the host.
+ *
+ * Strings are allocated in power of two blocks by a buddy allocator: a block
+ * is split from a larger one when its class runs out, and merged back with its
+ * buddy once both are released. The free lists are guarded by a process-shared
+ * mutex, while the reference counts are updated with atomic operations only.
+ */
+
+/* Includes ------------------------------------------------------------------*/
+
+#define _GNU_SOURCE
+
+#include "lib_strings_shm.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Definitions ---------------------------------------------------------------*/
+
+#define SHM_MAGIC "STRSHM2"
+#define SHM_MAGIC_LEN 8
+
+/* Blocks go from 32 bytes to the whole pool, by powers of two */
+#define SHM_MIN_SHIFT 5
+#define SHM_CLASSES (64 - SHM_MIN_SHIFT)
+
+/* Reference counts are shared between processes, they must not use locks */
+_Static_assert(ATOMIC_INT_LOCK_FREE == 2, "atomic ints are not lock-free");
+
+/**
+ * @brief Header of a string block, directly followed by its value. The offset
+ * of the block in the pool is the handle of the string.
+ */
+struct shm_block {
+        atomic_uint refs;
+        uint16_t size_class;
+        uint16_t free;
+        uint64_t len;   /* Offset of the next free block once released */
+};
+
+/**
+ * @brief Released block, linked both ways in the free list of its class so
+ * that merging takes it out in constant time.
+ */
+struct shm_free_block {
+        struct shm_block block;
+        uint64_t prev;
+};
+
+/**
+ * @brief Header of a pool, at the start of its shared memory file.
+ */
+struct shm_header {
+        char magic[SHM_MAGIC_LEN];
+        uint64_t size;
+        uint64_t free[SHM_CLASSES];
+        pthread_mutex_t lock;
+};
+
+/* Blocks start aligned after the header of the pool */
+#define SHM_DATA ((sizeof(struct shm_header) + STRING_ALIGNMENT - 1) \
+                & ~(size_t)(STRING_ALIGNMENT - 1))
+
+_Static_assert(sizeof(struct shm_free_block) <= ((size_t)1 << SHM_MIN_SHIFT),
+                "released blocks don't fit in the smallest class");
+
+struct string_shm {
+        struct shm_header *header;
+        size_t size;
+        int fd;
+};
+
+/* Static functions ----------------------------------------------------------*/
+
+static uint64_t class_size(unsigned int size_class)
+{
+        return (uint64_t)1 << (size_class + SHM_MIN_SHIFT);
+}
+
+/**
+ * @brief Returns the size class of the block holding a value of length 'len',
+ * which is lower than the size of the pool.
+ */
+static unsigned int block_class(size_t len)
+{
+        const size_t size = sizeof(struct shm_block) + len + 1;
+
+        if (size <= class_size(0))
+                return 0;
+
+        return (unsigned int)(sizeof(unsigned long long) * 8
+                        - (size_t)__builtin_clzll(size - 1)) - SHM_MIN_SHIFT;
+}
+
+/**
+ * @brief Returns the block of the string 'handle' of 'shm', or NULL if
+ * 'handle' doesn't point to a live string.
+ */
+static struct shm_block *handle_to_block(const struct string_shm *shm,
+                uint64_t handle)
+{
+        const uint64_t limit = shm->size - STRING_TAIL_PADDING;
+
+        if (handle < SHM_DATA || handle % STRING_ALIGNMENT
+                        || handle > limit - sizeof(struct shm_block))
+                return NULL;
+
+        struct shm_block *block = (struct shm_block *)((char *)shm->header
+                        + handle);
+        if (block->free || block->size_class >= SHM_CLASSES
+                        || class_size(block->size_class) > limit - handle
+                        || block->len >= class_size(block->size_class)
+                                        - sizeof(*block)
+                        || atomic_load(&block->refs) == 0)
+                return NULL;
+
+        return block;
+}
+
+/**
+ * @brief Locks the free lists of 'header'. They are taken over as they are if
+ * a process died holding the lock, an interrupted update may lose blocks.
+ */
+static void lock_pool(struct shm_header *header)
+{
+        if (pthread_mutex_lock(&header->lock) == EOWNERDEAD)
+                pthread_mutex_consistent(&header->lock);
+}
+
+static void unlock_pool(struct shm_header *header)
+{
+        pthread_mutex_unlock(&header->lock);
+}
+
+static struct shm_free_block *offset_to_free(struct shm_header *header,
+                uint64_t offset)
+{
+        return (struct shm_free_block *)((char *)header + offset);
+}
+
+/**
+ * @brief Pushes the block at 'offset' on the free list of the class
+ * 'size_class' of 'header'.
+ */
+static void push_free(struct shm_header *header, unsigned int size_class,
+                uint64_t offset)
+{
+        struct shm_free_block *released = offset_to_free(header, offset);
+        const uint64_t next = header->free[size_class];
+
+        released->block.size_class = (uint16_t)size_class;
+        released->block.free = 1;
+        released->block.len = next;
+        released->prev = 0;
+        if (next)
+                offset_to_free(header, next)->prev = offset;
+
+        header->free[size_class] = offset;
+}
+
+/**
+ * @brief Takes the released block at 'offset' out of its free list.
+ */
+static void remove_free(struct shm_header *header, uint64_t offset)
+{
+        struct shm_free_block *released = offset_to_free(header, offset);
+        const uint64_t next = released->block.len;
+        const uint64_t prev = released->prev;
+
+        if (prev)
+                offset_to_free(header, prev)->block.len = next;
+        else
+                header->free[released->block.size_class] = next;
+
+        if (next)
+                offset_to_free(header, next)->prev = prev;
+
+        released->block.free = 0;
+}
+
+/**
+ * @brief Returns the size of the area of 'shm' managed by the allocator, it
+ * starts at SHM_DATA.
+ */
+static uint64_t data_size(const struct string_shm *shm)
+{
+        return shm->size - STRING_TAIL_PADDING - SHM_DATA;
+}
+
+/**
+ * @brief Allocates a block of the class 'size_class' from 'shm', splitting a
+ * larger one if its own class has none left.
+ *
+ * @return The offset of the block on success.
+ * @return 0 if the pool is full.
+ */
+static uint64_t alloc_block(struct string_shm *shm, unsigned int size_class)
+{
+        struct shm_header *header = shm->header;
+        unsigned int found = size_class;
+
+        lock_pool(header);
+
+        while (found < SHM_CLASSES && !header->free[found])
+                ++found;
+
+        if (found == SHM_CLASSES) {
+                unlock_pool(header);
+                return 0;
+        }
+
+        const uint64_t offset = header->free[found];
+        remove_free(header, offset);
+
+        /* The upper halves of the split blocks are released */
+        while (found > size_class) {
+                --found;
+                push_free(header, found, offset + class_size(found));
+        }
+
+        offset_to_free(header, offset)->block.size_class =
+                        (uint16_t)size_class;
+        unlock_pool(header);
+        return offset;
+}
+
+/**
+ * @brief Releases the block at 'offset' of 'shm', merged with its buddy as
+ * long as it is released too.
+ */
+static void free_block(struct string_shm *shm, uint64_t offset)
+{
+        struct shm_header *header = shm->header;
+        const uint64_t limit = data_size(shm);
+
+        lock_pool(header);
+
+        unsigned int size_class = offset_to_free(header, offset)
+                        ->block.size_class;
+        while (size_class + 1 < SHM_CLASSES) {
+                const uint64_t size = class_size(size_class);
+                const uint64_t buddy = (offset - SHM_DATA) ^ size;
+                if (buddy > limit - size)
+                        break;
+
+                const struct shm_block *block = &offset_to_free(header,
+                                SHM_DATA + buddy)->block;
+                if (!block->free || block->size_class != size_class)
+                        break;
+
+                remove_free(header, SHM_DATA + buddy);
+                offset = SHM_DATA + ((offset - SHM_DATA) & ~size);
+                ++size_class;
+        }
+
+        push_free(header, size_class, offset);
+        unlock_pool(header);
+}
+
+/**
+ * @brief Releases the whole data area of the new pool 'shm', as the largest
+ * aligned blocks that fit.
+ */
+static void carve_pool(struct string_shm *shm)
+{
+        const uint64_t limit = data_size(shm);
+        uint64_t pos = 0;
+
+        while (limit - pos >= class_size(0)) {
+                unsigned int size_class = 0;
+
+                while (size_class + 1 < SHM_CLASSES
+                                && class_size(size_class + 1) <= limit - pos
+                                && pos % class_size(size_class + 1) == 0)
+                        ++size_class;
+
+                push_free(shm->header, size_class, SHM_DATA + pos);
+                pos += class_size(size_class);
+        }
+}
+
+/**
+ * @brief Maps the 'size' bytes of the shared memory file of 'shm'.
+ *
+ * @return 0 on success.
+ * @return -ENOMEM on failure.
+ */
+static int map_pool(struct string_shm *shm, size_t size)
+{
+        void *base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                        shm->fd, 0);
+        if (base == MAP_FAILED)
+                return -ENOMEM;
+
+        shm->header = base;
+        shm->size = size;
+        return 0;
+}
+
+/**
+ * @brief Initializes the header of the new pool 'shm', whose file is zero
+ * filled.
+ *
+ * @return 0 on success.
+ * @return A negative errno on failure.
+ */
+static int init_pool(struct string_shm *shm)
+{
+        struct shm_header *header = shm->header;
+        pthread_mutexattr_t attr;
+        int res;
+
+        res = pthread_mutexattr_init(&attr);
+        if (res)
+                return -res;
+
+        res = pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+        if (!res)
+                res = pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+        if (!res)
+                res = pthread_mutex_init(&header->lock, &attr);
+
+        pthread_mutexattr_destroy(&attr);
+        if (res)
+                return -res;
+
+        header->size = shm->size;
+        carve_pool(shm);
+        memcpy(header->magic, SHM_MAGIC, SHM_MAGIC_LEN);
+        return 0;
+}
+
+/* API -----------------------------------------------------------------------*/
+
+struct string_shm *string_shm_create(size_t size)
+{
+        const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+
+        if (size < SHM_DATA + STRING_TAIL_PADDING || size > SIZE_MAX - page)
+                return NULL;
+
+        struct string_shm *shm = malloc(sizeof(*shm));
+        if (!shm)
+                return NULL;
+
+        size = (size + page - 1) & ~(page - 1);
+        shm->fd = memfd_create("lib_strings", MFD_CLOEXEC);
+        if (shm->fd < 0)
+                goto error_create;
+
+        if (ftruncate(shm->fd, (off_t)size) < 0 || map_pool(shm, size) < 0)
+                goto error_map;
+
+        if (init_pool(shm) < 0)
+                goto error_init;
+
+        return shm;
+
+error_init:
+        munmap(shm->header, shm->size);
+error_map:
+        close(shm->fd);
+error_create:
+        free(shm);
+        return NULL;
+}
+
+struct string_shm *string_shm_open(int fd)
+{
+        struct stat st;
+
+        if (fd < 0 || fstat(fd, &st) < 0
+                        || st.st_size < (off_t)(SHM_DATA + STRING_TAIL_PADDING))
+                return NULL;
+
+        struct string_shm *shm = malloc(sizeof(*shm));
+        if (!shm)
+                return NULL;
+
+        shm->fd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+        if (shm->fd < 0)
+                goto error_dup;
+
+        if (map_pool(shm, (size_t)st.st_size) < 0)
+                goto error_map;
+
+        if (memcmp(shm->header->magic, SHM_MAGIC, SHM_MAGIC_LEN)
+                        || shm->header->size != shm->size)
+                goto error_check;
+
+        return shm;
+
+error_check:
+        munmap(shm->header, shm->size);
+error_map:
+        close(shm->fd);
+error_dup:
+        free(shm);
+        return NULL;
+}
+
+void string_shm_destroy(struct string_shm *shm)
+{
+        if (!shm)
+                return;
+
+        munmap(shm->header, shm->size);
+        close(shm->fd);
+        free(shm);
+}
+
+int string_shm_fd(const struct string_shm *shm)
+{
+        if (!shm)
+                return -EINVAL;
+
+        return shm->fd;
+}
+
+int string_shm_dup_v(struct string_shm *shm, const char *src, size_t len,
+                uint64_t *handle)
+{
+        if (!shm || !src || !handle)
+                return -EINVAL;
+
+        if (len >= shm->size)
+                return -ENOMEM;
+
+        const unsigned int size_class = block_class(len);
+        const uint64_t offset = alloc_block(shm, size_class);
+        if (!offset)
+                return -ENOMEM;
+
+        struct shm_block *block = (struct shm_block *)((char *)shm->header
+                        + offset);
+        char *value = (char *)(block + 1);
+
+        memcpy(value, src, len);
+        value[len] = '\0';
+        block->len = len;
+        atomic_store(&block->refs, 1);
+
+        *handle = offset;
+        return 0;
+}
+
+int string_shm_dup(struct string_shm *shm, const struct string *src,
+                uint64_t *handle)
+{
+        if (!src)
+                return -EINVAL;
+
+        return string_shm_dup_v(shm, src->value, (size_t)string_len(src),
+                        handle);
+}
+
+int string_shm_get(struct string_shm *shm, uint64_t handle)
+{
+        if (!shm)
+                return -EINVAL;
+
+        struct shm_block *block = handle_to_block(shm, handle);
+        if (!block)
+                return -EINVAL;
+
+        atomic_fetch_add_explicit(&block->refs, 1, memory_order_relaxed);
+        return 0;
+}
+
+int string_shm_put(struct string_shm *shm, uint64_t handle)
+{
+        if (!shm)
+                return -EINVAL;
+
+        struct shm_block *block = handle_to_block(shm, handle);
+        if (!block)
+                return -EINVAL;
+
+        if (atomic_fetch_sub_explicit(&block->refs, 1,
+                        memory_order_acq_rel) == 1)
+                free_block(shm, handle);
+
+        return 0;
+}
+
+int string_shm_view(const struct string_shm *shm, uint64_t handle,
+                struct string_view *view)
+{
+        if (!shm || !view)
+                return -EINVAL;
+
+        const struct shm_block *block = handle_to_block(shm, handle);
+        if (!block)
+                return -EINVAL;
+
+        view->value = (const char *)(block + 1);
+        view->len = (size_t)block->len;
+        return 0;
+}
@@ -0,0 +1,313 @@
+/**
+ * @author Maxence ROBIN
+ * @brief Internal vector helpers shared by the vectorized kernels.
+ *
+ * The kernels are written with the GCC vector extensions so that they compile
+ * to the best instruction set enabled for the translation unit and fall back
+ * to plain scalar code on targets without SIMD registers.
+ */
+
+#ifndef LIB_STRINGS_SIMD_H
+#define LIB_STRINGS_SIMD_H
+
+/* Includes ------------------------------------------------------------------*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/* Definitions ---------------------------------------------------------------*/
+
+#define SIMD_WIDTH 16
+
+typedef uint8_t simd_u8 __attribute__((vector_size(SIMD_WIDTH)));
+typedef uint32_t simd_u32 __attribute__((vector_size(SIMD_WIDTH)));
+
+#define SIMD_U32_LANES (SIMD_WIDTH / sizeof(uint32_t))
+
+#define SIMD_CONTENT_NON_ASCII (1U << 0)
+#define SIMD_CONTENT_NUL (1U << 1)
+
+/* Static functions ----------------------------------------------------------*/
+
+static inline simd_u32 simd_load_u32(const uint32_t *src)
+{
+        simd_u32 v;
+        memcpy(&v, src, sizeof(v));
+        return v;
+}
+
+static inline void simd_store_u32(uint32_t *dest, simd_u32 v)
+{
+        memcpy(dest, &v, sizeof(v));
+}
+
+/**
+ * @brief Returns the lane-wise unsigned minimum of 'a' and 'b'.
+ */
+static inline simd_u32 simd_min_u32(simd_u32 a, simd_u32 b)
+{
+        const simd_u32 mask = (simd_u32)(a < b);
+        return (a & mask) | (b & ~mask);
+}
+
+/**
+ * @brief Returns a mask with the bit i set if the i-th bytes of 'a' and 'b'
+ * are equal, for the SIMD_WIDTH first bytes.
+ */
+static inline unsigned int simd_eq_mask(const char *a, const char *b)
+{
+#if defined(__SSE2__)
+        const __m128i va = _mm_loadu_si128((const __m128i *)a);
+        const __m128i vb = _mm_loadu_si128((const __m128i *)b);
+        return (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(va, vb));
+#else
+        unsigned int mask = 0;
+        for (size_t i = 0; i < SIMD_WIDTH; ++i)
+                mask |= (unsigned int)(a[i] == b[i]) << i;
+        return mask;
+#endif
+}
+
+#define SIMD_FULL_MASK ((1U << SIMD_WIDTH) - 1)
+
+/**
+ * @brief Returns the length of the common prefix of the char arrays 'a' and
+ * 'b' of length 'len'.
+ */
+static inline size_t simd_common_prefix(const char *a, const char *b,
+                size_t len)
+{
+        size_t i = 0;
+
+        for (; i + SIMD_WIDTH <= len; i += SIMD_WIDTH) {
+                const unsigned int mask = simd_eq_mask(a + i, b + i);
+                if (mask != SIMD_FULL_MASK)
+                        return i + (size_t)__builtin_ctz(~mask);
+        }
+
+        while (i < len && a[i] == b[i])
+                ++i;
+
+        return i;
+}
+
+/**
+ * @brief Returns the length of the common suffix of the char arrays 'a' and
+ * 'b' of length 'len'.
+ */
+static inline size_t simd_common_suffix(const char *a, const char *b,
+                size_t len)
+{
+        size_t i = 0;
+
+        for (; i + SIMD_WIDTH <= len; i += SIMD_WIDTH) {
+                const size_t start = len - i - SIMD_WIDTH;
+                const unsigned int mask = simd_eq_mask(a + start, b + start);
+                if (mask != SIMD_FULL_MASK) {
+                        const unsigned int diff = ~mask & SIMD_FULL_MASK;
+                        const int last = 31 - __builtin_clz(diff);
+                        return i + (size_t)(SIMD_WIDTH - 1 - last);
+                }
+        }
+
+        while (i < len && a[len - i - 1] == b[len - i - 1])
+                ++i;
+
+        return i;
+}
+
+/**
+ * @brief Returns the position of the first byte of the char array 'src' of
+ * length 'len' equal to 'a', 'b', 'c' or 'd', or 'len' if there is none.
+ * Needles can be repeated to look for fewer bytes.
+ */
+static inline size_t simd_find_any4(const char *src, size_t len, char a,
+                char b, char c, char d)
+{
+        size_t i = 0;
+
+#if defined(__SSE2__)
+        const __m128i va = _mm_set1_epi8(a);
+        const __m128i vb = _mm_set1_epi8(b);
+        const __m128i vc = _mm_set1_epi8(c);
+        const __m128i vd = _mm_set1_epi8(d);
+
+        for (; i + SIMD_WIDTH <= len; i += SIMD_WIDTH) {
+                const __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+                const __m128i eq = _mm_or_si128(
+                                _mm_or_si128(_mm_cmpeq_epi8(v, va),
+                                                _mm_cmpeq_epi8(v, vb)),
+                                _mm_or_si128(_mm_cmpeq_epi8(v, vc),
+                                                _mm_cmpeq_epi8(v, vd)));
+                const unsigned int mask = (unsigned int)_mm_movemask_epi8(eq);
+                if (mask)
+                        return i + (size_t)__builtin_ctz(mask);
+        }
+#endif
+
+        for (; i < len; ++i) {
+                if (src[i] == a || src[i] == b || src[i] == c || src[i] == d)
+                        return i;
+        }
+
+        return len;
+}
+
+/**
+ * @brief Scans the char array 'src' of length 'len' in one pass.
+ *
+ * @return SIMD_CONTENT_NON_ASCII if it holds a byte above 0x7f, ored with
+ * SIMD_CONTENT_NUL if it holds a '\0'.
+ */
+static inline unsigned int simd_scan_content(const char *src, size_t len)
+{
+        unsigned int flags = 0;
+        size_t i = 0;
+
+#if defined(__SSE2__)
+        const __m128i zero = _mm_setzero_si128();
+        __m128i high = zero;
+        __m128i nul = zero;
+
+        for (; i + SIMD_WIDTH <= len; i += SIMD_WIDTH) {
+                const __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+                high = _mm_or_si128(high, v);
+                nul = _mm_or_si128(nul, _mm_cmpeq_epi8(v, zero));
+        }
+
+        if (_mm_movemask_epi8(high))
+                flags |= SIMD_CONTENT_NON_ASCII;
+        if (_mm_movemask_epi8(nul))
+                flags |= SIMD_CONTENT_NUL;
+#endif
+
+        for (; i < len; ++i) {
+                if ((unsigned char)src[i] > 0x7f)
+                        flags |= SIMD_CONTENT_NON_ASCII;
+                else if (src[i] == '\0')
+                        flags |= SIMD_CONTENT_NUL;
+        }
+
+        return flags;
+}
+
+/**
+ * @brief Returns the length of the leading run of ASCII bytes of the char
+ * array 'src' of length 'len'.
+ */
+static inline size_t simd_ascii_prefix(const char *src, size_t len)
+{
+        size_t i = 0;
+
+#if defined(__SSE2__)
+        for (; i + SIMD_WIDTH <= len; i += SIMD_WIDTH) {
+                const __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+                const unsigned int mask = (unsigned int)_mm_movemask_epi8(v);
+                if (mask)
+                        return i + (size_t)__builtin_ctz(mask);
+        }
+#endif
+
+        while (i < len && (unsigned char)src[i] <= 0x7f)
+                ++i;
+
+        return i;
+}
+
+/**
+ * @brief Returns the number of bytes of the char array 'src' of length 'len'
+ * that are not UTF-8 continuation bytes, which is its number of codepoints if
+ * it is valid UTF-8.
+ */
+static inline size_t simd_count_utf8_chars(const char *src, size_t len)
+{
+        size_t count = 0;
+        size_t i = 0;
+
+#if defined(__SSE2__)
+        /* Continuation bytes are 0x80 to 0xbf, that is -128 to -65 signed */
+        const __m128i last_continuation = _mm_set1_epi8(-65);
+
+        for (; i + SIMD_WIDTH <= len; i += SIMD_WIDTH) {
+                const __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+                const __m128i lead = _mm_cmpgt_epi8(v, last_continuation);
+                count += (size_t)__builtin_popcount(
+                                (unsigned int)_mm_movemask_epi8(lead));
+        }
+#endif
+
+        for (; i < len; ++i)
+                count += (((unsigned char)src[i] & 0xc0) != 0x80);
+
+        return count;
+}
+
+/**
+ * @brief Returns the mask of the 'len' first bytes of a vector, 'len' being at
+ * most SIMD_WIDTH.
+ */
+static inline unsigned int simd_head_mask(size_t len)
+{
+        return (1U << len) - 1;
+}
+
+/**
+ * @brief Same as simd_scan_content(), for a value with STRING_TAIL_PADDING
+ * readable bytes past 'len'. The tail is loaded as a whole vector and masked.
+ */
+static inline unsigned int simd_scan_content_padded(const char *src,
+                size_t len)
+{
+#if defined(__SSE2__)
+        const __m128i zero = _mm_setzero_si128();
+        unsigned int high = 0;
+        unsigned int nul = 0;
+
+        for (size_t i = 0; i < len; i += SIMD_WIDTH) {
+                const __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+                const unsigned int mask = (len - i < SIMD_WIDTH
+                                ? simd_head_mask(len - i) : SIMD_FULL_MASK);
+                high |= (unsigned int)_mm_movemask_epi8(v) & mask;
+                nul |= (unsigned int)_mm_movemask_epi8(
+                                _mm_cmpeq_epi8(v, zero)) & mask;
+        }
+
+        return (high ? SIMD_CONTENT_NON_ASCII : 0)
+                        | (nul ? SIMD_CONTENT_NUL : 0);
+#else
+        return simd_scan_content(src, len);
+#endif
+}
+
+/**
+ * @brief Same as simd_count_utf8_chars(), for a value with STRING_TAIL_PADDING
+ * readable bytes past 'len'. The tail is loaded as a whole vector and masked.
+ */
+static inline size_t simd_count_utf8_chars_padded(const char *src,
+                size_t len)
+{
+#if defined(__SSE2__)
+        const __m128i last_continuation = _mm_set1_epi8(-65);
+        size_t count = 0;
+
+        for (size_t i = 0; i < len; i += SIMD_WIDTH) {
+                const __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+                const __m128i lead = _mm_cmpgt_epi8(v, last_continuation);
+                const unsigned int mask = (len - i < SIMD_WIDTH
+                                ? simd_head_mask(len - i) : SIMD_FULL_MASK);
+                count += (size_t)__builtin_popcount(
+                                (unsigned int)_mm_movemask_epi8(lead) & mask);
+        }
+
+        return count;
+#else
+        return simd_count_utf8_chars(src, len);
+#endif
+}
+
+#endif /* LIB_STRINGS_SIMD_H */
@@ -0,0 +1,222 @@
+/**
+ * @author Maxence ROBIN
+ * @brief Provides owning slices sharing the buffer of a parent string.
+ */
+
+/* Includes ------------------------------------------------------------------*/
+
+#include "lib_strings_slice.h"
+
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+
+/* Definitions ---------------------------------------------------------------*/
+
+/* Slices up to this length are copied rather than shared */
+#define SLICE_COPY_MAX 64
+
+/* A slice is compacted if its buffer is this many times larger than itself */
+#define COMPACT_RATIO 8
+
+/**
+ * @brief String shared by slices, released along with its last reference.
+ */
+struct slice_buffer {
+        atomic_size_t refs;
+        struct string *str;
+};
+
+struct string_slice {
+        struct slice_buffer *buffer;
+        size_t start;
+        size_t len;
+};
+
+/* Static functions ----------------------------------------------------------*/
+
+/**
+ * @brief Creates a slice of 'len' characters of 'buffer' starting at 'start',
+ * taking over a reference on 'buffer'.
+ *
+ * @return Pointer to the new slice on success.
+ * @return NULL on failure.
+ */
+static struct string_slice *create_slice(struct slice_buffer *buffer,
+                size_t start, size_t len)
+{
+        struct string_slice *slice = malloc(sizeof(*slice));
+        if (!slice)
+                return NULL;
+
+        slice->buffer = buffer;
+        slice->start = start;
+        slice->len = len;
+        return slice;
+}
+
+/**
+ * @brief Creates a buffer holding a single reference over 'str', which is
+ * taken over.
+ *
+ * @return Pointer to the new buffer on success.
+ * @return NULL on failure.
+ */
+static struct slice_buffer *create_buffer(struct string *str)
+{
+        struct slice_buffer *buffer = malloc(sizeof(*buffer));
+        if (!buffer)
+                return NULL;
+
+        atomic_init(&buffer->refs, 1);
+        buffer->str = str;
+        return buffer;
+}
+
+/**
+ * @brief Creates a buffer holding a copy of the char array 'src' of length
+ * 'len'.
+ *
+ * @return Pointer to the new buffer on success.
+ * @return NULL on failure.
+ */
+static struct slice_buffer *copy_buffer(const char *src, size_t len)
+{
+        struct string *str = string_dup_v(src, len);
+        if (!str)
+                return NULL;
+
+        struct slice_buffer *buffer = create_buffer(str);
+        if (!buffer)
+                string_destroy(str);
+
+        return buffer;
+}
+
+static void release_buffer(struct slice_buffer *buffer)
+{
+        if (atomic_fetch_sub_explicit(&buffer->refs, 1,
+                        memory_order_acq_rel) != 1)
+                return;
+
+        /* The buffer took over the string, even a frozen one */
+        if (string_is_frozen(buffer->str))
+                string_destroy_frozen(buffer->str);
+        else
+                string_destroy(buffer->str);
+
+        free(buffer);
+}
+
+static const char *slice_value(const struct string_slice *slice)
+{
+        return slice->buffer->str->value + slice->start;
+}
+
+/* API -----------------------------------------------------------------------*/
+
+struct string_slice *string_slice_take(struct string *str)
+{
+        if (!str)
+                return NULL;
+
+        struct slice_buffer *buffer = create_buffer(str);
+        if (!buffer)
+                return NULL;
+
+        struct string_slice *slice = create_slice(buffer, 0,
+                        (size_t)string_len(str));
+        if (!slice)
+                free(buffer);
+
+        return slice;
+}
+
+struct string_slice *string_slice_sub(const struct string_slice *parent,
+                size_t start, size_t len)
+{
+        if (!parent || start > parent->len || len > parent->len - start)
+                return NULL;
+
+        struct slice_buffer *buffer;
+
+        if (len <= SLICE_COPY_MAX) {
+                buffer = copy_buffer(slice_value(parent) + start, len);
+                if (!buffer)
+                        return NULL;
+
+                start = 0;
+        } else {
+                buffer = parent->buffer;
+                atomic_fetch_add_explicit(&buffer->refs, 1,
+                                memory_order_relaxed);
+                start += parent->start;
+        }
+
+        struct string_slice *slice = create_slice(buffer, start, len);
+        if (!slice)
+                release_buffer(buffer);
+
+        return slice;
+}
+
+void string_slice_destroy(struct string_slice *slice)
+{
+        if (!slice)
+                return;
+
+        release_buffer(slice->buffer);
+        free(slice);
+}
+
+struct string_view string_slice_view(const struct string_slice *slice)
+{
+        if (!slice)
+                return (struct string_view){ NULL, 0 };
+
+        return (struct string_view){ slice_value(slice), slice->len };
+}
+
+struct string *string_slice_dup(const struct string_slice *slice)
+{
+        if (!slice)
+                return NULL;
+
+        return string_dup_v(slice_value(slice), slice->len);
+}
+
+int string_slice_compact(struct string_slice *slice)
+{
+        if (!slice)
+                return -EINVAL;
+
+        struct slice_buffer *buffer = slice->buffer;
+        const size_t buffer_len = (size_t)string_len(buffer->str);
+
+        if (slice->len > buffer_len / COMPACT_RATIO)
+                return 0;
+
+        /* The last slice of a buffer owns it, it is cut in place unless
+         * frozen */
+        if (atomic_load_explicit(&buffer->refs, memory_order_acquire) == 1
+                        && !string_is_frozen(buffer->str)) {
+                const int res = string_cut(buffer->str, slice->start,
+                                slice->len);
+                if (res < 0)
+                        return res;
+
+                slice->start = 0;
+                string_fit(buffer->str);
+                return 1;
+        }
+
+        struct slice_buffer *copy = copy_buffer(slice_value(slice),
+                        slice->len);
+        if (!copy)
+                return -ENOMEM;
+
+        release_buffer(buffer);
+        slice->buffer = copy;
+        slice->start = 0;
+        return 1;
+}
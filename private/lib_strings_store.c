@@ -0,0 +1,275 @@
+/**
+ * @author Maxence ROBIN
+ * @brief Provides a compact store of immutable strings referenced by 32 bits
+ * handles.
+ *
+ * A handle holds the index of a slab in its high bits and the offset of the
+ * string in the slab in its low bits, resolving it takes a single lookup in
+ * the array of slabs. Strings larger than a slab get a slab of their own.
+ */
+
+/* Includes ------------------------------------------------------------------*/
+
+#include "lib_strings_store.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Definitions ---------------------------------------------------------------*/
+
+#define SLAB_SHIFT 20
+#define SLAB_SIZE ((size_t)1 << SLAB_SHIFT)
+#define OFFSET_MASK ((uint32_t)SLAB_SIZE - 1)
+#define MAX_SLABS ((uint32_t)1 << (32 - SLAB_SHIFT))
+
+/* Encoded lengths take at most this many bytes */
+#define VARINT_MAX_LEN 10
+
+struct store_slab {
+        unsigned char *data;
+        size_t size;
+        size_t used;
+};
+
+struct string_store {
+        struct store_slab *slabs;
+        uint32_t slab_count;
+        uint32_t slab_capacity;
+        size_t count;
+};
+
+/* Static functions ----------------------------------------------------------*/
+
+static size_t varint_len(size_t value)
+{
+        size_t len = 1;
+
+        while (value >= 0x80) {
+                value >>= 7;
+                ++len;
+        }
+
+        return len;
+}
+
+static unsigned char *put_varint(unsigned char *pos, size_t value)
+{
+        while (value >= 0x80) {
+                *pos++ = (unsigned char)(value | 0x80);
+                value >>= 7;
+        }
+
+        *pos++ = (unsigned char)value;
+        return pos;
+}
+
+/**
+ * @brief Decodes the varint at 'pos', before 'end', into 'value'.
+ *
+ * @return Pointer past the varint on success.
+ * @return NULL if the varint is truncated or too large.
+ */
+static const unsigned char *get_varint(const unsigned char *pos,
+                const unsigned char *end, size_t *value)
+{
+        *value = 0;
+
+        for (unsigned int shift = 0; shift < sizeof(size_t) * 8; shift += 7) {
+                if (pos == end)
+                        return NULL;
+
+                const unsigned char byte = *pos++;
+                *value |= (size_t)(byte & 0x7f) << shift;
+                if (!(byte & 0x80))
+                        return pos;
+        }
+
+        return NULL;
+}
+
+/**
+ * @brief Decodes the string at 'offset' in 'slab' into 'view'.
+ *
+ * @return The offset of the next string on success.
+ * @return 0 if there is no valid string at 'offset'.
+ */
+static size_t read_string(const struct store_slab *slab, size_t offset,
+                struct string_view *view)
+{
+        const unsigned char *end = slab->data + slab->used;
+        const unsigned char *pos = get_varint(slab->data + offset, end,
+                        &view->len);
+
+        if (!pos || view->len > (size_t)(end - pos))
+                return 0;
+
+        view->value = (const char *)pos;
+        return (size_t)(pos - slab->data) + view->len;
+}
+
+/**
+ * @brief Adds a slab able to hold 'size' bytes to 'store'.
+ *
+ * @return Pointer to the slab on success.
+ * @return NULL on failure or if 'store' has no slab left.
+ */
+static struct store_slab *add_slab(struct string_store *store, size_t size)
+{
+        if (store->slab_count == MAX_SLABS)
+                return NULL;
+
+        if (store->slab_count == store->slab_capacity) {
+                const uint32_t capacity = (store->slab_capacity
+                                ? store->slab_capacity * 2 : 16);
+                struct store_slab *slabs = realloc(store->slabs,
+                                capacity * sizeof(*slabs));
+                if (!slabs)
+                        return NULL;
+
+                store->slabs = slabs;
+                store->slab_capacity = capacity;
+        }
+
+        if (size < SLAB_SIZE)
+                size = SLAB_SIZE;
+
+        struct store_slab *slab = store->slabs + store->slab_count;
+        slab->data = malloc(size + STRING_TAIL_PADDING);
+        if (!slab->data)
+                return NULL;
+
+        slab->size = size;
+        slab->used = 0;
+        ++store->slab_count;
+        return slab;
+}
+
+/* API -----------------------------------------------------------------------*/
+
+struct string_store *string_store_create(void)
+{
+        struct string_store *store = malloc(sizeof(*store));
+        if (!store)
+                return NULL;
+
+        store->slabs = NULL;
+        store->slab_count = 0;
+        store->slab_capacity = 0;
+        store->count = 0;
+        return store;
+}
+
+void string_store_destroy(struct string_store *store)
+{
+        if (!store)
+                return;
+
+        for (uint32_t i = 0; i < store->slab_count; ++i)
+                free(store->slabs[i].data);
+
+        free(store->slabs);
+        free(store);
+}
+
+int string_store_add_v(struct string_store *store, const char *src,
+                size_t len, uint32_t *handle)
+{
+        if (!store || !src || !handle)
+                return -EINVAL;
+
+        if (len > SIZE_MAX - VARINT_MAX_LEN - STRING_TAIL_PADDING)
+                return -ENOMEM;
+
+        const size_t size = varint_len(len) + len;
+        struct store_slab *slab = (store->slab_count
+                        ? store->slabs + store->slab_count - 1 : NULL);
+
+        /* Strings must start in the range of the offsets of the handles */
+        if (!slab || size > slab->size - slab->used
+                        || slab->used > OFFSET_MASK) {
+                slab = add_slab(store, size);
+                if (!slab)
+                        return -ENOMEM;
+        }
+
+        unsigned char *pos = put_varint(slab->data + slab->used, len);
+        memcpy(pos, src, len);
+
+        *handle = (store->slab_count - 1) << SLAB_SHIFT
+                        | (uint32_t)slab->used;
+        slab->used += size;
+        ++store->count;
+        return 0;
+}
+
+int string_store_add(struct string_store *store, const struct string *src,
+                uint32_t *handle)
+{
+        if (!src)
+                return -EINVAL;
+
+        return string_store_add_v(store, src->value, (size_t)string_len(src),
+                        handle);
+}
+
+int string_store_get(const struct string_store *store, uint32_t handle,
+                struct string_view *view)
+{
+        if (!store || !view)
+                return -EINVAL;
+
+        const uint32_t index = handle >> SLAB_SHIFT;
+        const size_t offset = handle & OFFSET_MASK;
+
+        if (index >= store->slab_count
+                        || offset >= store->slabs[index].used
+                        || !read_string(store->slabs + index, offset, view))
+                return -EINVAL;
+
+        return 0;
+}
+
+ssize_t string_store_count(const struct string_store *store)
+{
+        if (!store)
+                return -EINVAL;
+
+        return (ssize_t)store->count;
+}
+
+int string_store_iter_init(struct string_store_iter *it,
+                const struct string_store *store)
+{
+        if (!it || !store)
+                return -EINVAL;
+
+        it->store = store;
+        it->slab = 0;
+        it->offset = 0;
+        return 0;
+}
+
+int string_store_next(struct string_store_iter *it, struct string_view *view,
+                uint32_t *handle)
+{
+        if (!it || !view)
+                return -EINVAL;
+
+        const struct string_store *store = it->store;
+
+        while (it->slab < store->slab_count
+                        && it->offset >= store->slabs[it->slab].used) {
+                ++it->slab;
+                it->offset = 0;
+        }
+
+        if (it->slab == store->slab_count)
+                return 0;
+
+        if (handle)
+                *handle = it->slab << SLAB_SHIFT | (uint32_t)it->offset;
+
+        it->offset = read_string(store->slabs + it->slab, it->offset, view);
+        return 1;
+}
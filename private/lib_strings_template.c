@@ -0,0 +1,362 @@
+/**
+ * @author Maxence ROBIN
+ * @brief Provides precompiled templates rendered into strings.
+ */
+
+/* Includes ------------------------------------------------------------------*/
+
+#include "lib_strings_template.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Definitions ---------------------------------------------------------------*/
+
+#define STACK_SLOTS 16
+
+enum segment_kind {
+        SEGMENT_LITERAL,
+        SEGMENT_SLOT,
+        SEGMENT_RAW_SLOT
+};
+
+/**
+ * @brief A literal run of the template or the name of a placeholder, viewing
+ * the template own copy of its source.
+ */
+struct template_segment {
+        enum segment_kind kind;
+        struct string_view text;
+};
+
+struct string_template {
+        struct string *source;
+        struct template_segment *segments;
+        size_t count;
+        size_t slots;
+        size_t literal_len;
+};
+
+/**
+ * @brief Number of bytes added by the escaping of each character, 0 for the
+ * clean characters which are copied as is.
+ */
+static const unsigned char html_extra[256] = {
+        ['&'] = 4, ['<'] = 3, ['>'] = 3, ['"'] = 5, ['\''] = 4,
+};
+
+static const unsigned char json_extra[256] = {
+        [0x00] = 5, [0x01] = 5, [0x02] = 5, [0x03] = 5, [0x04] = 5, [0x05] = 5,
+        [0x06] = 5, [0x07] = 5, ['\b'] = 1, ['\t'] = 1, ['\n'] = 1, [0x0b] = 5,
+        ['\f'] = 1, ['\r'] = 1, [0x0e] = 5, [0x0f] = 5, [0x10] = 5, [0x11] = 5,
+        [0x12] = 5, [0x13] = 5, [0x14] = 5, [0x15] = 5, [0x16] = 5, [0x17] = 5,
+        [0x18] = 5, [0x19] = 5, [0x1a] = 5, [0x1b] = 5, [0x1c] = 5, [0x1d] = 5,
+        [0x1e] = 5, [0x1f] = 5, ['"'] = 1, ['\\'] = 1,
+};
+
+/* Static functions ----------------------------------------------------------*/
+
+/**
+ * @brief Appends a segment to 'tpl'.
+ *
+ * @return 0 on success.
+ * @return -ENOMEM on failure.
+ */
+static int add_segment(struct string_template *tpl, size_t *capacity,
+                enum segment_kind kind, const char *text, size_t len)
+{
+        if (tpl->count == *capacity) {
+                const size_t new_capacity = *capacity * 2 + 4;
+                struct template_segment *segments = realloc(tpl->segments,
+                                new_capacity * sizeof(*segments));
+                if (!segments)
+                        return -ENOMEM;
+
+                tpl->segments = segments;
+                *capacity = new_capacity;
+        }
+
+        tpl->segments[tpl->count++] = (struct template_segment){
+                .kind = kind,
+                .text = { text, len },
+        };
+
+        if (kind == SEGMENT_LITERAL)
+                tpl->literal_len += len;
+        else
+                ++tpl->slots;
+
+        return 0;
+}
+
+/**
+ * @brief Returns the first occurrence of 'count' consecutive 'c' in the char
+ * array 'src' of length 'len', or NULL if there is none.
+ */
+static const char *find_run(const char *src, size_t len, char c, size_t count)
+{
+        const char *end = src + len;
+
+        while ((size_t)(end - src) >= count) {
+                const size_t span = (size_t)(end - src) - count + 1;
+                const char *pos = memchr(src, c, span);
+                if (!pos)
+                        return NULL;
+
+                size_t run = 1;
+                while (run < count && pos[run] == c)
+                        ++run;
+
+                if (run == count)
+                        return pos;
+
+                src = pos + run;
+        }
+
+        return NULL;
+}
+
+static const unsigned char *escape_table(enum string_escape escape)
+{
+        switch (escape) {
+        case STRING_ESCAPE_HTML:
+                return html_extra;
+        case STRING_ESCAPE_JSON:
+                return json_extra;
+        default:
+                return NULL;
+        }
+}
+
+/**
+ * @brief Returns the length of 'value' once escaped with 'table'.
+ */
+static size_t escaped_len(const unsigned char *table, struct string_view value)
+{
+        size_t len = value.len;
+
+        if (table) {
+                for (size_t i = 0; i < value.len; ++i)
+                        len += table[(unsigned char)value.value[i]];
+        }
+
+        return len;
+}
+
+/**
+ * @brief Writes the escaped form of the character 'c' at 'dest'.
+ *
+ * @return The number of written bytes.
+ */
+static size_t escape_char(enum string_escape escape, unsigned char c,
+                char *dest)
+{
+        static const char hex[] = "0123456789abcdef";
+        const char *seq;
+
+        if (escape == STRING_ESCAPE_HTML) {
+                switch (c) {
+                case '&': seq = "&amp;"; break;
+                case '<': seq = "&lt;"; break;
+                case '>': seq = "&gt;"; break;
+                case '"': seq = "&quot;"; break;
+                default: seq = "&#39;"; break;
+                }
+        } else {
+                switch (c) {
+                case '\b': seq = "\\b"; break;
+                case '\t': seq = "\\t"; break;
+                case '\n': seq = "\\n"; break;
+                case '\f': seq = "\\f"; break;
+                case '\r': seq = "\\r"; break;
+                case '"': seq = "\\\""; break;
+                case '\\': seq = "\\\\"; break;
+                default:
+                        memcpy(dest, "\\u00", 4);
+                        dest[4] = hex[c >> 4];
+                        dest[5] = hex[c & 0xf];
+                        return 6;
+                }
+        }
+
+        const size_t len = strlen(seq);
+        memcpy(dest, seq, len);
+        return len;
+}
+
+/**
+ * @brief Writes 'value' escaped with 'escape' at 'dest', copying the runs of
+ * clean characters in bulk.
+ *
+ * @return The number of written bytes.
+ */
+static size_t write_escaped(enum string_escape escape, struct string_view value,
+                char *dest)
+{
+        const unsigned char *table = escape_table(escape);
+        char *pos = dest;
+        size_t start = 0;
+
+        if (!table) {
+                memcpy(dest, value.value, value.len);
+                return value.len;
+        }
+
+        for (size_t i = 0; i < value.len; ++i) {
+                const unsigned char c = (unsigned char)value.value[i];
+                if (!table[c])
+                        continue;
+
+                memcpy(pos, value.value + start, i - start);
+                pos += i - start;
+                pos += escape_char(escape, c, pos);
+                start = i + 1;
+        }
+
+        memcpy(pos, value.value + start, value.len - start);
+        pos += value.len - start;
+        return (size_t)(pos - dest);
+}
+
+/* API -----------------------------------------------------------------------*/
+
+struct string_template *string_template_compile(const char *src, size_t len)
+{
+        if (!src)
+                return NULL;
+
+        struct string_template *tpl = calloc(1, sizeof(*tpl));
+        if (!tpl)
+                return NULL;
+
+        tpl->source = string_dup_v(src, len);
+        if (!tpl->source)
+                goto error;
+
+        const char *pos = tpl->source->value;
+        const char *end = pos + len;
+        size_t capacity = 0;
+
+        while (pos < end) {
+                const char *open = find_run(pos, (size_t)(end - pos), '{', 2);
+                const char *literal_end = (open ? open : end);
+
+                if (literal_end > pos && add_segment(tpl, &capacity,
+                                SEGMENT_LITERAL, pos,
+                                (size_t)(literal_end - pos)) < 0)
+                        goto error;
+
+                if (!open)
+                        break;
+
+                const int raw = (open + 2 < end && open[2] == '{');
+                const size_t braces = (raw ? 3 : 2);
+                const char *name = open + braces;
+                const char *close = find_run(name, (size_t)(end - name), '}',
+                                braces);
+                if (!close)
+                        goto error;
+
+                const char *name_end = close;
+                while (name < name_end && *name == ' ')
+                        ++name;
+                while (name_end > name && name_end[-1] == ' ')
+                        --name_end;
+                if (name == name_end)
+                        goto error;
+
+                if (add_segment(tpl, &capacity,
+                                (raw ? SEGMENT_RAW_SLOT : SEGMENT_SLOT), name,
+                                (size_t)(name_end - name)) < 0)
+                        goto error;
+
+                pos = close + braces;
+        }
+
+        return tpl;
+
+error:
+        string_template_destroy(tpl);
+        return NULL;
+}
+
+void string_template_destroy(struct string_template *tpl)
+{
+        if (!tpl)
+                return;
+
+        string_destroy(tpl->source);
+        free(tpl->segments);
+        free(tpl);
+}
+
+int string_template_render(const struct string_template *tpl,
+                string_template_lookup lookup, void *ctx,
+                enum string_escape escape, struct string *dest)
+{
+        if (!tpl || !lookup || !dest)
+                return -EINVAL;
+        if (string_is_frozen(dest))
+                return -EPERM;
+
+        struct string_view stack_values[STACK_SLOTS];
+        struct string_view *values = stack_values;
+        const unsigned char *table = escape_table(escape);
+        size_t total = tpl->literal_len;
+        size_t slot = 0;
+        int res = 0;
+
+        if (tpl->slots > STACK_SLOTS) {
+                values = malloc(tpl->slots * sizeof(*values));
+                if (!values)
+                        return -ENOMEM;
+        }
+
+        /* Resolve every placeholder first to size 'dest' exactly once */
+        for (size_t i = 0; i < tpl->count; ++i) {
+                const struct template_segment *seg = tpl->segments + i;
+                if (seg->kind == SEGMENT_LITERAL)
+                        continue;
+
+                struct string_view *value = values + slot++;
+                res = lookup(ctx, seg->text, value);
+                if (res < 0)
+                        goto out;
+
+                if (seg->kind == SEGMENT_SLOT)
+                        total += escaped_len(table, *value);
+                else
+                        total += value->len;
+        }
+
+        res = string_resize(dest, total);
+        if (res < 0)
+                goto out;
+
+        char *pos = dest->value;
+        slot = 0;
+        for (size_t i = 0; i < tpl->count; ++i) {
+                const struct template_segment *seg = tpl->segments + i;
+
+                switch (seg->kind) {
+                case SEGMENT_LITERAL:
+                        memcpy(pos, seg->text.value, seg->text.len);
+                        pos += seg->text.len;
+                        break;
+                case SEGMENT_SLOT:
+                        pos += write_escaped(escape, values[slot++], pos);
+                        break;
+                case SEGMENT_RAW_SLOT:
+                        pos += write_escaped(STRING_ESCAPE_NONE, values[slot++],
+                                        pos);
+                        break;
+                }
+        }
+
+out:
+        if (values != stack_values)
+                free(values);
+
+        return res;
+}
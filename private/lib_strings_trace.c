@@ -0,0 +1,87 @@
+/**
+ * @author Maxence ROBIN
+ * @brief Internal recording of the calls of the string API.
+ */
+
+/* Includes ------------------------------------------------------------------*/
+
+#include "lib_strings_trace.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Definitions ---------------------------------------------------------------*/
+
+#define DEFAULT_TRACE_FILE "strings.trace"
+#define TRACE_BUFFER_SIZE (1024 * 1024)
+
+/* Static variables ----------------------------------------------------------*/
+
+static atomic_ulong last_id;
+
+static pthread_once_t trace_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static FILE *trace_file;
+static int with_content;
+
+/* Static functions ----------------------------------------------------------*/
+
+static void open_trace(void)
+{
+        const char *path = getenv("STRINGS_TRACE_FILE");
+        const char *content = getenv("STRINGS_TRACE_CONTENT");
+
+        with_content = (content && strcmp(content, "1") == 0);
+
+        trace_file = fopen(path ? path : DEFAULT_TRACE_FILE, "wb");
+        if (!trace_file)
+                return;
+
+        /* The stream is flushed and closed by exit() */
+        setvbuf(trace_file, NULL, _IOFBF, TRACE_BUFFER_SIZE);
+
+        fwrite(TRACE_MAGIC, 1, TRACE_MAGIC_LEN, trace_file);
+        putc(TRACE_VERSION, trace_file);
+        putc(with_content ? TRACE_FLAG_CONTENT : 0, trace_file);
+}
+
+static void put_varint(unsigned long long value)
+{
+        while (value >= 0x80) {
+                putc((int)(value & 0x7f) | 0x80, trace_file);
+                value >>= 7;
+        }
+
+        putc((int)value, trace_file);
+}
+
+/* API -----------------------------------------------------------------------*/
+
+unsigned long trace_new_id(void)
+{
+        return atomic_fetch_add_explicit(&last_id, 1, memory_order_relaxed)
+                        + 1;
+}
+
+void trace_record(enum trace_op op, unsigned long id, size_t a, size_t b,
+                const char *content)
+{
+        pthread_once(&trace_once, open_trace);
+        if (!trace_file)
+                return;
+
+        pthread_mutex_lock(&trace_lock);
+
+        putc((int)op, trace_file);
+        put_varint(id);
+        put_varint(a);
+        put_varint(b);
+
+        if (with_content && content)
+                fwrite(content, 1, a, trace_file);
+
+        pthread_mutex_unlock(&trace_lock);
+}
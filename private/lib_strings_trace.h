@@ -0,0 +1,68 @@
+/**
+ * @author Maxence ROBIN
+ * @brief Internal recording of the calls of the string API, only compiled in
+ * with STRINGS_TRACE.
+ *
+ * A trace starts with TRACE_MAGIC, then a version byte and a flags byte. Each
+ * record is an operation byte followed by the handle id and two arguments,
+ * all LEB128 encoded. If TRACE_FLAG_CONTENT is set, the operations carrying
+ * content are then followed by 'a' bytes of it.
+ */
+
+#ifndef LIB_STRINGS_TRACE_H
+#define LIB_STRINGS_TRACE_H
+
+/* Includes ------------------------------------------------------------------*/
+
+#include <stddef.h>
+
+/* Definitions ---------------------------------------------------------------*/
+
+#define TRACE_MAGIC "STRTRACE"
+#define TRACE_MAGIC_LEN 8
+#define TRACE_VERSION 1
+
+#define TRACE_FLAG_CONTENT (1U << 0)
+
+/**
+ * @brief Traced operations and their arguments, unused ones being 0.
+ */
+enum trace_op {
+    TRACE_CREATE,   /* a: length, content */
+    TRACE_RESERVED, /* a: maximal length */
+    TRACE_DESTROY,
+    TRACE_COPY,     /* a: length, content */
+    TRACE_APPEND,   /* a: length, content */
+    TRACE_PREPEND,  /* a: length, content */
+    TRACE_CUT,      /* a: length, b: start */
+    TRACE_RESIZE,   /* a: length */
+    TRACE_CLEAR,
+    TRACE_RESERVE,  /* a: size */
+    TRACE_FIT,
+    TRACE_PRINTF,   /* a: length, content */
+    TRACE_OP_COUNT
+};
+
+/* API -----------------------------------------------------------------------*/
+
+#ifdef STRINGS_TRACE
+
+/**
+ * @brief Returns a new handle id, ids start at 1.
+ */
+unsigned long trace_new_id(void);
+
+/**
+ * @brief Records the operation 'op' on the handle 'id'. 'content' holds 'a'
+ * bytes for the operations carrying content, it is only written out if the
+ * STRINGS_TRACE_CONTENT environment variable is set to 1.
+ *
+ * The trace is written to the file named by the STRINGS_TRACE_FILE
+ * environment variable, "strings.trace" by default.
+ */
+void trace_record(enum trace_op op, unsigned long id, size_t a, size_t b,
+                const char *content);
+
+#endif /* STRINGS_TRACE */
+
+#endif /* LIB_STRINGS_TRACE_H */
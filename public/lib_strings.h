@@ -9,14 +9,65 @@
 /* Includes ------------------------------------------------------------------*/
 
 #include <stddef.h>
+#include <stdint.h>
 #include <sys/types.h>
 
 /* Definitions ---------------------------------------------------------------*/
 
+/**
+ * @brief Guarantees on the value of every string : it starts on a
+ * STRING_ALIGNMENT boundary, and the STRING_TAIL_PADDING bytes past its
+ * capacity are readable.
+ *
+ * Kernels can thus load whole vectors up to the capacity of a string, past its
+ * length, and mask the bytes they don't need. The content of the padding is
+ * unspecified and it must never be written.
+ */
+#define STRING_ALIGNMENT 16
+#define STRING_TAIL_PADDING 64
+
 struct string {
     char *value;
 };
 
+/**
+ * @brief Options of string_freeze().
+ */
+#define STRING_FREEZE_FIT (1U << 0)         /* Trim the capacity */
+#define STRING_FREEZE_HASH (1U << 1)        /* Precompute the hash */
+#define STRING_FREEZE_READONLY (1U << 2)    /* Move to read-only pages */
+
+/**
+ * @brief Backing of the values of large strings.
+ */
+enum string_huge_mode {
+    STRING_HUGE_OFF,        /* Regular heap allocations */
+    STRING_HUGE_MADVISE,    /* Aligned mappings advised to use huge pages */
+    STRING_HUGE_HUGETLB     /* Explicit huge pages, else as MADVISE */
+};
+
+/**
+ * @brief Non-owning reference to 'len' characters starting at 'value'.
+ *
+ * @warning A view is not null terminated and is only valid as long as the
+ * viewed string is neither modified nor destroyed.
+ */
+struct string_view {
+    const char *value;
+    size_t len;
+};
+
+struct string_arena;
+struct string_arena_block;
+
+/**
+ * @brief Position in a string arena, to rewind it to.
+ */
+struct string_arena_mark {
+    const struct string_arena_block *block;
+    size_t used;
+};
+
 /* API -----------------------------------------------------------------------*/
 
 /* Creation functions ----------------*/
@@ -29,11 +80,29 @@ struct string {
  */
 struct string *string_empty();
 
+/**
+ * @brief Creates an empty string that can grow up to at least 'max_len'
+ * characters without its value ever moving.
+ *
+ * The whole range is reserved as address space once, and its pages are only
+ * committed as the string grows. Pointers into 'str->value' and views of the
+ * string thus stay valid across appends.
+ *
+ * @return Pointer to the new string on success.
+ * @return NULL on failure.
+ *
+ * @note The reserved range is rounded up to the page size, growing the string
+ * past it fails with -ENOMEM.
+ */
+struct string *string_reserved(size_t max_len);
+
 /**
  * @brief Dupplicates 'src'.
  *
  * @return Pointer to the new string on success.
  * @return NULL on failure.
+ *
+ * @note Frozen strings are not copied, 'src' itself is returned.
  */
 struct string *string_dup(const struct string *src);
 
@@ -65,7 +134,7 @@ struct string *string_dup_v(const char *src, size_t len);
  * @warning No check is made on src for the '\0' terminating byte, 'start' and
  * 'len' have to be correctly used.
  */
-struct string *string_sub_v(const char *src, unsigned int start, size_t len);
+struct string *string_sub_v(const char *src, size_t start, size_t len);
 
 /**
  * @brief Creates a string from a printf() format 'format' with the exact
@@ -76,18 +145,45 @@ struct string *string_sub_v(const char *src, unsigned int start, size_t len);
  */
 struct string *string_format(const char *format, ...);
 
+/**
+ * @brief Duplicates the 'count' char arrays of 'srcs' of lengths 'lens' into
+ * the array 'strs', in as few allocations as possible.
+ *
+ * The strings and their values are packed in shared slabs, each freed once all
+ * its strings are destroyed. They are regular strings otherwise, a value that
+ * outgrows its slot moves to its own allocation.
+ *
+ * @return 0 on success.
+ * @return -EINVAL if 'srcs', 'lens', 'strs' or any char array are invalid.
+ * @return -ENOMEM on failure, no string is created then.
+ *
+ * @note A batch is best destroyed with string_destroy_many(), which drops the
+ * strings of each slab at once.
+ */
+int string_dup_many(const char *const *srcs, const size_t *lens,
+                size_t count, struct string **strs);
+
 /* Modification functions ------------*/
 
 /**
  * @brief Destroys 'str'.
+ *
+ * @note Frozen strings are left untouched, see string_destroy_frozen().
  */
 void string_destroy(const struct string *str);
 
+/**
+ * @brief Destroys the 'count' strings of the array 'strs'. NULL strings are
+ * skipped.
+ */
+void string_destroy_many(struct string *const *strs, size_t count);
+
 /**
  * @brief Makes 'str' empty.
  *
  * @return 0 on success.
  * @return -EINVAL if 'str' is invalid.
+ * @return -EPERM if 'str' is frozen.
  */
 int string_clear(struct string *str);
 
@@ -96,6 +192,7 @@ int string_clear(struct string *str);
  *
  * @return 0 on success.
  * @return -EINVAL if 'dest' or 'src' are invalid.
+ * @return -EPERM if 'dest' is frozen.
  * @return -ENOMEM on failure.
  */
 int string_copy(struct string *dest, const struct string *src);
@@ -105,6 +202,7 @@ int string_copy(struct string *dest, const struct string *src);
  *
  * @return 0 on success.
  * @return -EINVAL if 'dest' or 'src' are invalid.
+ * @return -EPERM if 'dest' is frozen.
  * @return -ENOMEM on failure.
  *
  * @note This version uses strlen() to determine the length of 'src'. It can be
@@ -118,6 +216,7 @@ int string_copy_c(struct string *dest, const char *src);
  *
  * @return 0 on success.
  * @return -EINVAL if 'dest' or 'src' are invalid.
+ * @return -EPERM if 'dest' is frozen.
  * @return -ENOMEM on failure.
  */
 int string_copy_v(struct string *dest, const char *src, size_t len);
@@ -127,6 +226,7 @@ int string_copy_v(struct string *dest, const char *src, size_t len);
  *
  * @return 0 on success.
  * @return -EINVAL if 'dest' or 'src' are invalid.
+ * @return -EPERM if 'dest' is frozen.
  * @return -ENOMEM on failure.
  */
 int string_append(struct string *dest, const struct string *src);
@@ -136,6 +236,7 @@ int string_append(struct string *dest, const struct string *src);
  *
  * @return 0 on success.
  * @return -EINVAL if 'dest' or 'src' are invalid.
+ * @return -EPERM if 'dest' is frozen.
  * @return -ENOMEM on failure.
  *
  * @note This version uses strlen() to determine the length of 'src'. It can be
@@ -149,6 +250,7 @@ int string_append_c(struct string *dest, const char *src);
  *
  * @return 0 on success.
  * @return -EINVAL if 'dest' or 'src' are invalid.
+ * @return -EPERM if 'dest' is frozen.
  * @return -ENOMEM on failure.
  */
 int string_append_v(struct string *dest, const char *src, size_t len);
@@ -158,6 +260,7 @@ int string_append_v(struct string *dest, const char *src, size_t len);
  *
  * @return 0 on success.
  * @return -EINVAL if 'dest' or 'src' are invalid.
+ * @return -EPERM if 'dest' is frozen.
  * @return -ENOMEM on failure.
  */
 int string_prepend(struct string *dest, const struct string *src);
@@ -180,6 +283,7 @@ int string_prepend_c(struct string *dest, const char *src);
  *
  * @return 0 on success.
  * @return -EINVAL if 'dest' or 'src' are invalid.
+ * @return -EPERM if 'dest' is frozen.
  * @return -ENOMEM on failure.
  */
 int string_prepend_v(struct string *dest, const char *src, size_t len);
@@ -189,21 +293,48 @@ int string_prepend_v(struct string *dest, const char *src, size_t len);
  *
  * @return 0 on success.
  * @return -EINVAL if 'str' is invalid.
+ * @return -EPERM if 'str' is frozen.
  * @return -ERANGE if 'start' + 'len' is greater than the length of 'str'.
  */
-int string_cut(struct string *str, unsigned int start, size_t len);
+int string_cut(struct string *str, size_t start, size_t len);
+
+/**
+ * @brief Sets the length of 'str' to 'len' characters and null terminates it,
+ * reallocating if needed.
+ *
+ * @return 0 on success.
+ * @return -EINVAL if 'str' is invalid.
+ * @return -EPERM if 'str' is frozen.
+ * @return -ENOMEM on failure.
+ *
+ * @note The characters added by this function are left uninitialized, they are
+ * meant to be written directly through 'str->value'.
+ */
+int string_resize(struct string *str, size_t len);
+
+/**
+ * @brief Tells that the content of 'str' was written directly through
+ * 'str->value', which drops the cached properties of its content.
+ *
+ * @warning This must be called after any direct write, otherwise the content
+ * functions can return stale results. Frozen strings must never be written.
+ */
+void string_invalidate(struct string *str);
 
 /**
  * @brief Writes the formatted input into 'str'.
  *
  * @return The number of written bytes into the string on success.
  * @return -EINVAL if 'str' or format are invalid.
+ * @return -EPERM if 'str' is frozen.
+ * @return -EOVERFLOW if the output does not fit in an int, 'str' is then
+ * left empty.
  *
  * @note If the output was truncated, the return value is the number of
  * chraracters which would have been written to 'str' if enough space had
  * been available.
  */
-int string_printf(struct string *str, const char *format, ...);
+ssize_t string_printf(struct string *str, const char *format, ...);
 
 /* Utility functions -----------------*/
 /**
@@ -219,6 +350,9 @@ ssize_t string_len(const struct string *str);
  *
  * @return The capacity of 'str' on success.
  * @return -EINVAL if 'str' is invalid.
+ *
+ * @note 'str->value' can be read up to the capacity plus STRING_TAIL_PADDING
+ * bytes.
  */
 ssize_t string_capacity(const struct string *str);
 
@@ -227,6 +361,7 @@ ssize_t string_capacity(const struct string *str);
  *
  * @return 0 on success.
  * @return -EINVAL if 'str' is invalid.
+ * @return -EPERM if 'str' is frozen.
  * @return -ENOMEM on failure.
  *
  * @note If 'size' is lower than the capacity of 'str', this function does
@@ -239,8 +374,238 @@ int string_reserve(struct string *str, size_t size);
  *
  * @return 0 on success.
  * @return -EINVAL if 'str' is invalid.
+ * @return -EPERM if 'str' is frozen.
  * @return -ENOMEM on failure.
+ *
+ * @note The capacity is the usable size of the block given by the allocator,
+ * which can be slightly above the length of 'str'.
  */
 int string_fit(struct string *str);
 
+/**
+ * @brief Reduces the capacity of each string of the array 'strs' of 'count'
+ * strings in order to match its length. NULL strings are skipped.
+ *
+ * @return 0 on success.
+ * @return -EINVAL if 'strs' is invalid.
+ * @return -ENOMEM or -EPERM if any string failed to shrink or is frozen, the
+ * others still did.
+ */
+int string_fit_all(struct string **strs, size_t count);
+
+/* Configuration functions -----------*/
+
+/**
+ * @brief Sets how the values of at least 'threshold' bytes are allocated.
+ * Outside of STRING_HUGE_OFF, they are mapped on 2 MB aligned regions backed
+ * by huge pages to reduce TLB misses during scans over large strings, and
+ * their capacity is rounded up to a multiple of 2 MB.
+ *
+ * @return 0 on success.
+ * @return -EINVAL if 'mode' is invalid.
+ *
+ * @note The setting is process-wide and only applies to later allocations, it
+ * is meant to be set once before any string is shared between threads.
+ */
+int string_set_huge_pages(enum string_huge_mode mode, size_t threshold);
+
+/**
+ * @brief Sets when strings give back their unused capacity. A string whose
+ * length stays under 1 / 'ratio' of its capacity for 'delay' modifications in
+ * a row, or which is cleared, shrinks to twice its length. Capacities never
+ * shrink under 'min_capacity' bytes. A 'ratio' of 0, the default, disables
+ * shrinking.
+ *
+ * @return 0 on success.
+ * @return -EINVAL if 'ratio' is lower than 4 or 'delay' greater than 65535.
+ *
+ * @note Requiring a ratio of at least 4 keeps a shrunk string away from both
+ * the growth and the shrink thresholds, so that it does not shrink and grow
+ * back over and over.
+ *
+ * @warning The setting is process-wide, it is meant to be set once before any
+ * string is shared between threads. A shrink may move 'str->value'.
+ */
+int string_set_shrink_policy(unsigned int ratio, unsigned int delay,
+                size_t min_capacity);
+
+/**
+ * @brief Returns the name of the instruction set the vectorized kernels were
+ * dispatched to when the library was loaded : "scalar", "sse2" or "avx2".
+ *
+ * @note The best level supported by the CPU is picked. The STRINGS_SIMD_LEVEL
+ * environment variable can force a lower one for testing and benchmarking.
+ */
+const char *string_simd_level(void);
+
+/* Content functions -----------------*/
+
+/*
+ * The properties of the content of a string are computed by a vectorized scan
+ * the first time they are needed, then cached and kept up to date by the
+ * modification functions : appending two ASCII strings gives an ASCII string
+ * without scanning anything.
+ */
+
+/**
+ * @brief Tells whether 'str' only holds ASCII characters.
+ *
+ * @return 1 if 'str' is ASCII, 0 otherwise.
+ * @return -EINVAL if 'str' is invalid.
+ */
+int string_is_ascii(const struct string *str);
+
+/**
+ * @brief Tells whether 'str' holds an embedded '\0'.
+ *
+ * @return 1 if 'str' holds a '\0' before its end, 0 otherwise.
+ * @return -EINVAL if 'str' is invalid.
+ */
+int string_has_nul(const struct string *str);
+
+/**
+ * @brief Tells whether 'str' is valid UTF-8.
+ *
+ * @return 1 if 'str' is valid UTF-8, 0 otherwise.
+ * @return -EINVAL if 'str' is invalid.
+ *
+ * @note ASCII strings are known to be valid without being validated.
+ */
+int string_is_utf8(const struct string *str);
+
+/**
+ * @brief Returns the number of UTF-8 codepoints of 'str'.
+ *
+ * @return The number of codepoints of 'str' on success.
+ * @return -EINVAL if 'str' is invalid.
+ * @return -EILSEQ if 'str' is not valid UTF-8.
+ *
+ * @note This is O(1) for ASCII strings.
+ */
+ssize_t string_utf8_len(const struct string *str);
+
+/**
+ * @brief Returns the byte offset of the UTF-8 codepoint 'index' of 'str'.
+ *
+ * @return The byte offset of the codepoint on success, the length of 'str' if
+ * 'index' is its number of codepoints.
+ * @return -EINVAL if 'str' is invalid.
+ * @return -EILSEQ if 'str' is not valid UTF-8.
+ * @return -ERANGE if 'index' is greater than the number of codepoints.
+ *
+ * @note This is O(1) for ASCII strings.
+ */
+ssize_t string_utf8_offset(const struct string *str, size_t index);
+
+/* Frozen functions ------------------*/
+
+/**
+ * @brief Makes 'str' immutable, so that it can be shared between threads
+ * without locks nor reference counts.
+ *
+ * The properties of its content are computed once and for all, a frozen
+ * string is then never written again by the library: every function reading
+ * it is safe to call concurrently, and its value can live in read-only
+ * memory. Every function modifying it fails with -EPERM.
+ *
+ * The options of 'flags' are:
+ * - STRING_FREEZE_FIT trims its capacity down to its length.
+ * - STRING_FREEZE_HASH precomputes its hash for string_hash().
+ * - STRING_FREEZE_READONLY moves its value to pages mapped read-only.
+ *
+ * @return 0 on success.
+ * @return -EINVAL if 'str' or 'flags' are invalid.
+ * @return -EPERM if 'str' is already frozen.
+ * @return -ENOMEM on failure, 'str' is then left mutable.
+ *
+ * @warning The pointer must be published to the other threads after the call,
+ * through a release store or any synchronization.
+ */
+int string_freeze(struct string *str, unsigned int flags);
+
+/**
+ * @brief Tells if 'str' is frozen.
+ *
+ * @return 1 if 'str' is frozen, 0 otherwise.
+ * @return -EINVAL if 'str' is invalid.
+ */
+int string_is_frozen(const struct string *str);
+
+/**
+ * @brief Computes the 64 bits FNV-1a hash of 'str' into 'hash'.
+ *
+ * @return 0 on success.
+ * @return -EINVAL if 'str' or 'hash' are invalid.
+ *
+ * @note This is O(1) for strings frozen with STRING_FREEZE_HASH.
+ */
+int string_hash(const struct string *str, uint64_t *hash);
+
+/**
+ * @brief Destroys the frozen string 'str', which string_destroy() leaves
+ * untouched since its copies are the same pointer.
+ *
+ * @warning No thread may use 'str' or any of its copies anymore.
+ */
+void string_destroy_frozen(const struct string *str);
+
+/* Arena functions -------------------*/
+
+/**
+ * @brief Creates an empty arena allocating strings from blocks of
+ * 'block_size' bytes, or a default size if 'block_size' is 0.
+ *
+ * Arena strings are regular strings, allocated by bumping a pointer. Their
+ * memory is released all at once by string_arena_rewind() or
+ * string_arena_destroy(), destroying them on their own is optional. A string
+ * outgrowing its value moves it to the heap, where it stays until the string
+ * or the arena is destroyed.
+ *
+ * @return Pointer to the new arena on success.
+ * @return NULL on failure.
+ *
+ * @warning An arena is not thread-safe.
+ */
+struct string_arena *string_arena_create(size_t block_size);
+
+/**
+ * @brief Destroys 'arena' along with all its strings.
+ */
+void string_arena_destroy(struct string_arena *arena);
+
+/**
+ * @brief Creates an empty string from 'arena'.
+ *
+ * @return Pointer to the new string on success.
+ * @return NULL on failure.
+ */
+struct string *string_arena_empty(struct string_arena *arena);
+
+/**
+ * @brief Duplicates the char array 'src' of length 'len' into a string from
+ * 'arena'.
+ *
+ * @return Pointer to the new string on success.
+ * @return NULL on failure.
+ */
+struct string *string_arena_dup_v(struct string_arena *arena, const char *src,
+                size_t len);
+
+/**
+ * @brief Returns the current position of 'arena', to rewind it to later.
+ */
+struct string_arena_mark string_arena_mark(const struct string_arena *arena);
+
+/**
+ * @brief Releases in one go every string allocated from 'arena' since 'mark'
+ * was taken. Its blocks are kept for the next strings.
+ *
+ * @note This is O(1). Grown values live on the heap until their string is
+ * destroyed or the arena is, so strings created before 'mark' may grow.
+ *
+ * @warning 'mark' is invalid once the arena has been rewound past it.
+ */
+void string_arena_rewind(struct string_arena *arena,
+                struct string_arena_mark mark);
+
 #endif /* LIB_STRINGS_H */
@@ -0,0 +1,137 @@
+/**
+ * @author Maxence ROBIN
+ * @brief Provides an append-only buffer made of a list of chunks.
+ *
+ * Appending never copies the data already held, unlike a string whose value
+ * is reallocated as it grows. The content is read segment by segment, written
+ * with writev() straight from the chunks, and only flattened into a
+ * contiguous string when really needed.
+ */
+
+#ifndef LIB_STRINGS_CHUNKS_H
+#define LIB_STRINGS_CHUNKS_H
+
+/* Includes ------------------------------------------------------------------*/
+
+#include "lib_strings.h"
+
+/* Definitions ---------------------------------------------------------------*/
+
+struct string_chunks;
+struct string_chunk;
+
+/**
+ * @brief Iterator over the segments of a chunked buffer. It must be set up
+ * with string_chunks_iter_init().
+ */
+struct string_chunks_iter {
+    const struct string_chunk *chunk;
+};
+
+/* API -----------------------------------------------------------------------*/
+
+/**
+ * @brief Creates an empty chunked buffer whose chunks hold 'chunk_size'
+ * bytes, or a default size if 'chunk_size' is 0.
+ *
+ * @return Pointer to the new buffer on success.
+ * @return NULL on failure.
+ */
+struct string_chunks *string_chunks_create(size_t chunk_size);
+
+/**
+ * @brief Destroys 'chunks'.
+ */
+void string_chunks_destroy(struct string_chunks *chunks);
+
+/**
+ * @brief Makes 'chunks' empty, keeping its first chunk for reuse.
+ *
+ * @return 0 on success.
+ * @return -EINVAL if 'chunks' is invalid.
+ */
+int string_chunks_clear(struct string_chunks *chunks);
+
+/**
+ * @brief Appends the content of 'src' at the end of 'chunks'.
+ *
+ * @return 0 on success.
+ * @return -EINVAL if 'chunks' or 'src' are invalid.
+ * @return -ENOMEM on failure.
+ */
+int string_chunks_append(struct string_chunks *chunks,
+                const struct string *src);
+
+/**
+ * @brief Appends the content of the string literal 'src' at the end of
+ * 'chunks'.
+ *
+ * @return 0 on success.
+ * @return -EINVAL if 'chunks' or 'src' are invalid.
+ * @return -ENOMEM on failure.
+ *
+ * @note This version uses strlen() to determine the length of 'src'. It can be
+ * better for performances to use string_chunks_append_v() coupled with sizeof
+ * instead.
+ */
+int string_chunks_append_c(struct string_chunks *chunks, const char *src);
+
+/**
+ * @brief Appends the content of the char array 'src' of length 'len' at the
+ * end of 'chunks'.
+ *
+ * @return 0 on success.
+ * @return -EINVAL if 'chunks' or 'src' are invalid.
+ * @return -ENOMEM on failure.
+ */
+int string_chunks_append_v(struct string_chunks *chunks, const char *src,
+                size_t len);
+
+/**
+ * @brief Returns the length of the content of 'chunks'.
+ *
+ * @return The length of 'chunks' on success.
+ * @return -EINVAL if 'chunks' is invalid.
+ */
+ssize_t string_chunks_len(const struct string_chunks *chunks);
+
+/**
+ * @brief Prepares 'it' to iterate over the segments of 'chunks'.
+ *
+ * @return 0 on success.
+ * @return -EINVAL if 'it' or 'chunks' are invalid.
+ */
+int string_chunks_iter_init(struct string_chunks_iter *it,
+                const struct string_chunks *chunks);
+
+/**
+ * @brief Writes a view of the next non-empty segment of 'it' into 'segment'.
+ *
+ * @return 1 if a segment was written.
+ * @return 0 if there are no segments left.
+ * @return -EINVAL if 'it' or 'segment' are invalid.
+ *
+ * @warning Segments stay valid until 'chunks' is cleared or destroyed.
+ */
+int string_chunks_next(struct string_chunks_iter *it,
+                struct string_view *segment);
+
+/**
+ * @brief Writes the whole content of 'chunks' to the file descriptor 'fd'
+ * with writev(), straight from the chunks.
+ *
+ * @return The number of written bytes on success.
+ * @return -EINVAL if 'chunks' is invalid.
+ * @return A negative errno if writev() fails.
+ */
+ssize_t string_chunks_write(int fd, const struct string_chunks *chunks);
+
+/**
+ * @brief Creates a contiguous string holding the content of 'chunks'.
+ *
+ * @return Pointer to the new string on success.
+ * @return NULL on failure or if 'chunks' is invalid.
+ */
+struct string *string_chunks_flatten(const struct string_chunks *chunks);
+
+#endif /* LIB_STRINGS_CHUNKS_H */
@@ -0,0 +1,68 @@
+/**
+ * @author Maxence ROBIN
+ * @brief Provides a Myers diff between two strings.
+ */
+
+#ifndef LIB_STRINGS_DIFF_H
+#define LIB_STRINGS_DIFF_H
+
+/* Includes ------------------------------------------------------------------*/
+
+#include "lib_strings.h"
+
+/* Definitions ---------------------------------------------------------------*/
+
+enum string_diff_mode {
+    STRING_DIFF_BYTES,
+    STRING_DIFF_LINES
+};
+
+enum string_diff_op {
+    STRING_DIFF_EQUAL,
+    STRING_DIFF_DELETE,
+    STRING_DIFF_INSERT
+};
+
+/**
+ * @brief One step of an edit script.
+ *
+ * 'a' views the concerned range of the old string and 'b' the concerned range
+ * of the new string. The view of the side not involved in a delete or an
+ * insert is empty and points at the position where the edit applies.
+ */
+struct string_edit {
+    enum string_diff_op op;
+    struct string_view a;
+    struct string_view b;
+};
+
+/**
+ * @brief Edit script turning a string into another one.
+ */
+struct string_diff {
+    struct string_edit *edits;
+    size_t count;
+};
+
+/* API -----------------------------------------------------------------------*/
+
+/**
+ * @brief Computes the shortest edit script turning 'a' into 'b', comparing
+ * either bytes or lines depending on 'mode'. Lines include their terminating
+ * '\n'.
+ *
+ * @return Pointer to the new edit script on success.
+ * @return NULL on failure or if 'a' or 'b' are invalid.
+ *
+ * @warning The views of the edit script point into 'a' and 'b', which must
+ * outlive it and remain unmodified.
+ */
+struct string_diff *string_diff(const struct string *a,
+                const struct string *b, enum string_diff_mode mode);
+
+/**
+ * @brief Destroys 'diff'.
+ */
+void string_diff_destroy(struct string_diff *diff);
+
+#endif /* LIB_STRINGS_DIFF_H */
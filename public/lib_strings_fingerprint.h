@@ -0,0 +1,90 @@
+/**
+ * @author Maxence ROBIN
+ * @brief Provides MinHash and SimHash fingerprints for near-duplicate
+ * detection.
+ *
+ * Both fingerprints are computed over the 'k' bytes long shingles of a string.
+ * Shingles are hashed with a rolling hash directly from the string content,
+ * nothing is allocated per shingle.
+ */
+
+#ifndef LIB_STRINGS_FINGERPRINT_H
+#define LIB_STRINGS_FINGERPRINT_H
+
+/* Includes ------------------------------------------------------------------*/
+
+#include "lib_strings.h"
+
+#include <stdint.h>
+
+/* API -----------------------------------------------------------------------*/
+
+/**
+ * @brief Computes the MinHash signature of 'str' into 'out', which must hold
+ * 'num_hashes' values.
+ *
+ * @return 0 on success.
+ * @return -EINVAL if 'str' or 'out' are invalid or if 'k' or 'num_hashes' are
+ * 0.
+ * @return -ENOMEM on failure.
+ *
+ * @note A string shorter than 'k' is hashed as a single shingle. All the
+ * values of the signature of an empty string are UINT32_MAX.
+ */
+int string_minhash(const struct string *str, size_t k, size_t num_hashes,
+                uint32_t *out);
+
+/**
+ * @brief Computes the MinHash signatures of the 'n' strings of 'strs' into
+ * 'out', which must hold 'n' * 'num_hashes' values. The signature of 'strs[i]'
+ * starts at 'out' + i * 'num_hashes'.
+ *
+ * @return 0 on success.
+ * @return -EINVAL if 'strs', one of its strings or 'out' are invalid, if
+ * 'k' or 'num_hashes' are 0 or if 'n' * 'num_hashes' values overflow.
+ * @return -ENOMEM on failure.
+ *
+ * @note The hash family is set up once for the whole batch, this is faster
+ * than calling string_minhash() on each string.
+ */
+int string_minhash_many(const struct string *const *strs, size_t n, size_t k,
+                size_t num_hashes, uint32_t *out);
+
+/**
+ * @brief Estimates the Jaccard similarity of the shingle sets of two strings
+ * from their MinHash signatures 'a' and 'b' of 'num_hashes' values.
+ *
+ * @return The estimated similarity, between 0 and 1.
+ */
+double string_minhash_similarity(const uint32_t *a, const uint32_t *b,
+                size_t num_hashes);
+
+/**
+ * @brief Computes the 64 bits SimHash of 'str' into 'out'.
+ *
+ * @return 0 on success.
+ * @return -EINVAL if 'str' or 'out' are invalid or if 'k' is 0.
+ *
+ * @note A string shorter than 'k' is hashed as a single shingle. The SimHash
+ * of an empty string is 0.
+ */
+int string_simhash(const struct string *str, size_t k, uint64_t *out);
+
+/**
+ * @brief Computes the SimHash of the 'n' strings of 'strs' into 'out', which
+ * must hold 'n' values.
+ *
+ * @return 0 on success.
+ * @return -EINVAL if 'strs', one of its strings or 'out' are invalid or if
+ * 'k' is 0.
+ */
+int string_simhash_many(const struct string *const *strs, size_t n, size_t k,
+                uint64_t *out);
+
+/**
+ * @brief Returns the number of differing bits between the SimHashes 'a' and
+ * 'b'. Near-duplicates have a small distance.
+ */
+unsigned int string_simhash_distance(uint64_t a, uint64_t b);
+
+#endif /* LIB_STRINGS_FINGERPRINT_H */
@@ -0,0 +1,72 @@
+/**
+ * @author Maxence ROBIN
+ * @brief Provides direct output of strings to file descriptors and streams.
+ *
+ * Formatted output goes to a buffer owned by the calling thread and reused
+ * for every line, which is written to its descriptor once full. Logging a
+ * line thus takes neither a string_format()/string_destroy() pair nor a
+ * system call of its own.
+ */
+
+#ifndef LIB_STRINGS_IO_H
+#define LIB_STRINGS_IO_H
+
+/* Includes ------------------------------------------------------------------*/
+
+#include "lib_strings.h"
+
+#include <stdio.h>
+
+/* API -----------------------------------------------------------------------*/
+
+/**
+ * @brief Writes the formatted input to 'fd' through the buffer of the calling
+ * thread. The buffer is written out once full, when output goes to another
+ * descriptor, and when the thread exits.
+ *
+ * @return The number of formatted bytes on success.
+ * @return -EINVAL if 'fd' or 'format' are invalid.
+ * @return -EOVERFLOW if the output does not fit in an int.
+ * @return -ENOMEM on failure.
+ * @return A negative errno if writing the buffer out failed, its pending
+ * output is then dropped.
+ *
+ * @note Output larger than the buffer is written directly.
+ *
+ * @warning The output of the other threads to 'fd' is not ordered with it.
+ * The buffer of the thread exiting the process is flushed, but those of the
+ * threads still running then are lost.
+ */
+ssize_t string_dprintf_buffered(int fd, const char *format, ...);
+
+/**
+ * @brief Writes the pending output of the buffer of the calling thread.
+ *
+ * @return 0 on success.
+ * @return A negative errno on failure, the pending output is then dropped.
+ */
+int string_flush_buffered(void);
+
+/**
+ * @brief Writes the whole content of 'str' to 'fd', straight from its value.
+ * Pending output of the calling thread to 'fd' is written first, in the same
+ * system call.
+ *
+ * @return The length of 'str' on success.
+ * @return -EINVAL if 'fd' or 'str' are invalid.
+ * @return A negative errno on failure, 'str' may then be partially written.
+ *
+ * @note Interrupted and partial writes are resumed.
+ */
+ssize_t string_write(int fd, const struct string *str);
+
+/**
+ * @brief Writes the whole content of 'str' to 'stream'.
+ *
+ * @return The length of 'str' on success.
+ * @return -EINVAL if 'stream' or 'str' are invalid.
+ * @return -EIO on failure.
+ */
+ssize_t string_fwrite(FILE *stream, const struct string *str);
+
+#endif /* LIB_STRINGS_IO_H */
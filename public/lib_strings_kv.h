@@ -0,0 +1,94 @@
+/**
+ * @author Maxence ROBIN
+ * @brief Provides zero-copy parsers of key/value pairs such as query strings
+ * and header blocks.
+ *
+ * The parsers yield views into the parsed string, nothing is allocated. The
+ * separators of each format are fixed at compile time so that the scanning
+ * loop is specialized for them.
+ */
+
+#ifndef LIB_STRINGS_KV_H
+#define LIB_STRINGS_KV_H
+
+/* Includes ------------------------------------------------------------------*/
+
+#include "lib_strings.h"
+
+/* Definitions ---------------------------------------------------------------*/
+
+#define STRING_KV_KEY_ESCAPED (1U << 0)
+#define STRING_KV_VALUE_ESCAPED (1U << 1)
+
+/**
+ * @brief Parsing state over a string. It must be set up with
+ * string_kv_init().
+ */
+struct string_kv_iter {
+    const char *pos;
+    const char *end;
+};
+
+/**
+ * @brief A key/value pair. 'escaped' tells with the STRING_KV_*_ESCAPED flags
+ * which views hold escape sequences and need to be decoded.
+ */
+struct string_kv {
+    struct string_view key;
+    struct string_view value;
+    unsigned int escaped;
+};
+
+/* API -----------------------------------------------------------------------*/
+
+/**
+ * @brief Prepares 'it' to parse the pairs of 'str'.
+ *
+ * @return 0 on success.
+ * @return -EINVAL if 'it' or 'str' are invalid.
+ *
+ * @warning 'str' must neither be modified nor destroyed while being parsed.
+ */
+int string_kv_init(struct string_kv_iter *it, const struct string *str);
+
+/**
+ * @brief Parses the next 'key=value' pair of a query string, pairs being
+ * separated by '&'. A pair without '=' has an empty value and empty pairs are
+ * skipped.
+ *
+ * @return 1 if a pair was written into 'kv'.
+ * @return 0 if there are no pairs left.
+ * @return -EINVAL if 'it' or 'kv' are invalid.
+ *
+ * @note Percent-encoded and '+' characters are left as is, 'kv->escaped' tells
+ * whether string_query_decode() is needed.
+ */
+int string_query_next(struct string_kv_iter *it, struct string_kv *kv);
+
+/**
+ * @brief Parses the next 'key: value' line of a header block, lines being
+ * separated by '\n' or "\r\n". Blanks around keys and values are trimmed, a
+ * line without ':' has an empty value and an empty line ends the block.
+ *
+ * @return 1 if a pair was written into 'kv'.
+ * @return 0 if there are no pairs left.
+ * @return -EINVAL if 'it' or 'kv' are invalid.
+ */
+int string_headers_next(struct string_kv_iter *it, struct string_kv *kv);
+
+/**
+ * @brief Decodes the percent-encoded and '+' characters of 'src' into 'out'.
+ * If 'src' holds no escape sequence, 'out' is 'src' itself, otherwise 'src'
+ * is decoded into 'scratch' and 'out' views it.
+ *
+ * @return 0 on success.
+ * @return -EINVAL if 'scratch' or 'out' are invalid.
+ * @return -EPERM if 'scratch' is frozen.
+ * @return -ENOMEM on failure.
+ *
+ * @note Invalid escape sequences are kept as is.
+ */
+int string_query_decode(struct string_view src, struct string *scratch,
+                struct string_view *out);
+
+#endif /* LIB_STRINGS_KV_H */
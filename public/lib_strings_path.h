@@ -0,0 +1,88 @@
+/**
+ * @author Maxence ROBIN
+ * @brief Provides allocation-free manipulation of '/' separated paths.
+ */
+
+#ifndef LIB_STRINGS_PATH_H
+#define LIB_STRINGS_PATH_H
+
+/* Includes ------------------------------------------------------------------*/
+
+#include "lib_strings.h"
+
+/* API -----------------------------------------------------------------------*/
+
+/**
+ * @brief Joins the path 'src' to the path 'dest' with a single '/'. If 'src'
+ * is absolute, it replaces 'dest'.
+ *
+ * @return 0 on success.
+ * @return -EINVAL if 'dest' or 'src' are invalid.
+ * @return -EPERM if 'dest' is frozen.
+ * @return -ENOMEM on failure.
+ */
+int string_path_join(struct string *dest, const struct string *src);
+
+/**
+ * @brief Joins the path string literal 'src' to the path 'dest' with a single
+ * '/'. If 'src' is absolute, it replaces 'dest'.
+ *
+ * @return 0 on success.
+ * @return -EINVAL if 'dest' or 'src' are invalid.
+ * @return -EPERM if 'dest' is frozen.
+ * @return -ENOMEM on failure.
+ *
+ * @note This version uses strlen() to determine the length of 'src'. It can be
+ * better for performances to use string_path_join_v() coupled with sizeof()
+ * instead.
+ */
+int string_path_join_c(struct string *dest, const char *src);
+
+/**
+ * @brief Joins the path char array 'src' of length 'len' to the path 'dest'
+ * with a single '/'. If 'src' is absolute, it replaces 'dest'.
+ *
+ * @return 0 on success.
+ * @return -EINVAL if 'dest' or 'src' are invalid.
+ * @return -EPERM if 'dest' is frozen.
+ * @return -ENOMEM on failure.
+ *
+ * @warning 'src' must not point into 'dest'.
+ */
+int string_path_join_v(struct string *dest, const char *src, size_t len);
+
+/**
+ * @brief Normalizes the path 'str' in place : repeated '/', '.' components,
+ * '..' components following a regular one and the trailing '/' are removed.
+ * '..' components at the root of an absolute path are dropped and an empty
+ * relative path becomes ".".
+ *
+ * @return 0 on success.
+ * @return -EINVAL if 'str' is invalid.
+ * @return -EPERM if 'str' is frozen.
+ * @return -ENOMEM on failure.
+ *
+ * @note This is done in a single forward pass and only allocates to turn an
+ * empty string into ".".
+ */
+int string_path_normalize(struct string *str);
+
+/**
+ * @brief Returns a view of the directory part of the path 'str', ignoring its
+ * trailing '/'. The directory of a path without '/' is ".".
+ *
+ * @return The directory view on success.
+ * @return A view with a NULL value if 'str' is invalid.
+ */
+struct string_view string_path_dirname(const struct string *str);
+
+/**
+ * @brief Returns a view of the last component of the path 'str', ignoring its
+ * trailing '/'. The last component of "/" is "/".
+ *
+ * @return The last component view on success.
+ * @return A view with a NULL value if 'str' is invalid.
+ */
+struct string_view string_path_basename(const struct string *str);
+
+#endif /* LIB_STRINGS_PATH_H */
@@ -0,0 +1,37 @@
+/**
+ * @author Maxence ROBIN
+ * @brief Provides per-thread scratch strings for temporaries.
+ *
+ * Each thread owns a small ring of pre-grown strings. Acquiring one replaces a
+ * string_empty()/string_destroy() pair by a lookup in the ring. Acquisitions
+ * can be nested, once the ring is exhausted regular strings are handed out.
+ */
+
+#ifndef LIB_STRINGS_SCRATCH_H
+#define LIB_STRINGS_SCRATCH_H
+
+/* Includes ------------------------------------------------------------------*/
+
+#include "lib_strings.h"
+
+/* API -----------------------------------------------------------------------*/
+
+/**
+ * @brief Acquires an empty scratch string of the calling thread.
+ *
+ * @return Pointer to the scratch string on success.
+ * @return NULL on failure.
+ *
+ * @warning The string must be released with string_scratch_release() by the
+ * same thread, never with string_destroy().
+ */
+struct string *string_scratch_acquire(void);
+
+/**
+ * @brief Releases the scratch string 'str' acquired by the calling thread. It
+ * is cleared, and trimmed if it grew past the capacity cap of the ring. A
+ * frozen one is destroyed and replaced in the ring.
+ */
+void string_scratch_release(struct string *str);
+
+#endif /* LIB_STRINGS_SCRATCH_H */
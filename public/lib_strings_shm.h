@@ -0,0 +1,114 @@
+/**
+ * @author Maxence ROBIN
+ * @brief Provides a pool of strings in shared memory, read in place by the
+ * processes of the host.
+ *
+ * The pool is backed by a memfd, which is shared by passing its descriptor
+ * to other processes, over a UNIX socket for instance. Strings are referenced
+ * by handles, offsets in the pool that mean the same in every process, so
+ * handing a string over only takes sending its handle.
+ *
+ * Strings are immutable and reference counted, each one is released along
+ * with its last reference, whichever process drops it.
+ */
+
+#ifndef LIB_STRINGS_SHM_H
+#define LIB_STRINGS_SHM_H
+
+/* Includes ------------------------------------------------------------------*/
+
+#include "lib_strings.h"
+
+#include <stdint.h>
+
+/* Definitions ---------------------------------------------------------------*/
+
+struct string_shm;
+
+/* API -----------------------------------------------------------------------*/
+
+/**
+ * @brief Creates a pool of 'size' bytes in a new shared memory file.
+ *
+ * @return Pointer to the new pool on success.
+ * @return NULL on failure or if 'size' is too small.
+ *
+ * @note 'size' is rounded up to the page size, and the pool can't grow.
+ */
+struct string_shm *string_shm_create(size_t size);
+
+/**
+ * @brief Maps the pool of the shared memory file 'fd', created by
+ * string_shm_create() in this process or another one. 'fd' is left open.
+ *
+ * @return Pointer to the pool on success.
+ * @return NULL on failure or if 'fd' holds no pool.
+ */
+struct string_shm *string_shm_open(int fd);
+
+/**
+ * @brief Unmaps 'shm' from this process. The strings of the pool stay valid
+ * in the other processes.
+ */
+void string_shm_destroy(struct string_shm *shm);
+
+/**
+ * @brief Returns the descriptor of the shared memory file of 'shm', to be
+ * passed to the other processes.
+ *
+ * @return The descriptor on success.
+ * @return -EINVAL if 'shm' is invalid.
+ */
+int string_shm_fd(const struct string_shm *shm);
+
+/**
+ * @brief Duplicates the char array 'src' of length 'len' into 'shm', and
+ * stores its handle in 'handle'. The caller holds its only reference.
+ *
+ * @return 0 on success.
+ * @return -EINVAL if 'shm', 'src' or 'handle' are invalid.
+ * @return -ENOMEM if the pool is full.
+ */
+int string_shm_dup_v(struct string_shm *shm, const char *src, size_t len,
+                uint64_t *handle);
+
+/**
+ * @brief Duplicates 'src' into 'shm', see string_shm_dup_v().
+ */
+int string_shm_dup(struct string_shm *shm, const struct string *src,
+                uint64_t *handle);
+
+/**
+ * @brief Takes a new reference on the string 'handle' of 'shm', typically
+ * before handing it to another process.
+ *
+ * @return 0 on success.
+ * @return -EINVAL if 'shm' or 'handle' are invalid.
+ */
+int string_shm_get(struct string_shm *shm, uint64_t handle);
+
+/**
+ * @brief Drops a reference on the string 'handle' of 'shm', which is released
+ * along with its last reference.
+ *
+ * @return 0 on success.
+ * @return -EINVAL if 'shm' or 'handle' are invalid.
+ */
+int string_shm_put(struct string_shm *shm, uint64_t handle);
+
+/**
+ * @brief Returns in 'view' a view of the string 'handle' of 'shm', read in
+ * place in the pool.
+ *
+ * @return 0 on success.
+ * @return -EINVAL if 'shm', 'view' or 'handle' are invalid.
+ *
+ * @note The value is null terminated, and starts and ends as the values of
+ * regular strings with regard to STRING_ALIGNMENT and STRING_TAIL_PADDING.
+ *
+ * @warning The view is only valid while a reference on the string is held.
+ */
+int string_shm_view(const struct string_shm *shm, uint64_t handle,
+                struct string_view *view);
+
+#endif /* LIB_STRINGS_SHM_H */
@@ -0,0 +1,87 @@
+/**
+ * @author Maxence ROBIN
+ * @brief Provides owning slices sharing the buffer of a parent string.
+ *
+ * Unlike a view, a slice holds a reference on its parent buffer and stays
+ * valid for as long as the slice itself exists. Extracting fields from a large
+ * string thus copies nothing, while the lifetimes stay safe.
+ */
+
+#ifndef LIB_STRINGS_SLICE_H
+#define LIB_STRINGS_SLICE_H
+
+/* Includes ------------------------------------------------------------------*/
+
+#include "lib_strings.h"
+
+/* Definitions ---------------------------------------------------------------*/
+
+struct string_slice;
+
+/* API -----------------------------------------------------------------------*/
+
+/**
+ * @brief Turns 'str' into a slice covering its whole content. 'str' is taken
+ * over by the slice and must not be used anymore.
+ *
+ * @return Pointer to the new slice on success.
+ * @return NULL on failure or if 'str' is invalid, 'str' is then left as is.
+ *
+ * @note A frozen 'str' is destroyed with string_destroy_frozen() along with
+ * the last slice, none of its copies may be used past that point.
+ */
+struct string_slice *string_slice_take(struct string *str);
+
+/**
+ * @brief Creates a slice of 'len' characters of 'parent' starting at 'start',
+ * sharing the buffer of 'parent'.
+ *
+ * @return Pointer to the new slice on success.
+ * @return NULL on failure, if 'parent' is invalid or if 'start' + 'len' is
+ * greater than the length of 'parent'.
+ *
+ * @note Slices of a few bytes are copied instead, they would otherwise cost
+ * more than they save and pin their parent buffer.
+ */
+struct string_slice *string_slice_sub(const struct string_slice *parent,
+                size_t start, size_t len);
+
+/**
+ * @brief Destroys 'slice'. The shared buffer is released along with its last
+ * slice.
+ *
+ * @note Slices of the same buffer can be destroyed from different threads.
+ */
+void string_slice_destroy(struct string_slice *slice);
+
+/**
+ * @brief Returns a view of the content of 'slice'.
+ *
+ * @return The view on success.
+ * @return A view with a NULL value if 'slice' is invalid.
+ *
+ * @warning The view is not null terminated and is only valid as long as
+ * 'slice' is neither compacted nor destroyed.
+ */
+struct string_view string_slice_view(const struct string_slice *slice);
+
+/**
+ * @brief Creates a string holding a copy of the content of 'slice'.
+ *
+ * @return Pointer to the new string on success.
+ * @return NULL on failure or if 'slice' is invalid.
+ */
+struct string *string_slice_dup(const struct string_slice *slice);
+
+/**
+ * @brief Copies 'slice' out of its shared buffer if it only covers a small
+ * part of it, so that it stops pinning the whole buffer.
+ *
+ * @return 1 if 'slice' was copied out.
+ * @return 0 if 'slice' was left as is.
+ * @return -EINVAL if 'slice' is invalid.
+ * @return -ENOMEM on failure, 'slice' is then left as is.
+ */
+int string_slice_compact(struct string_slice *slice);
+
+#endif /* LIB_STRINGS_SLICE_H */
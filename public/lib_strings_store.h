@@ -0,0 +1,107 @@
+/**
+ * @author Maxence ROBIN
+ * @brief Provides a compact store of immutable strings referenced by 32 bits
+ * handles.
+ *
+ * Strings are packed back to back in large slabs, each one prefixed by its
+ * length encoded as a varint. A short string thus costs its 4 bytes handle
+ * and a single byte of length on top of its content, against about 40 bytes
+ * for a struct string on 64 bits hosts.
+ */
+
+#ifndef LIB_STRINGS_STORE_H
+#define LIB_STRINGS_STORE_H
+
+/* Includes ------------------------------------------------------------------*/
+
+#include "lib_strings.h"
+
+#include <stdint.h>
+
+/* Definitions ---------------------------------------------------------------*/
+
+struct string_store;
+
+/**
+ * @brief Iterator over the strings of a store, in insertion order. It must be
+ * set up with string_store_iter_init().
+ */
+struct string_store_iter {
+    const struct string_store *store;
+    uint32_t slab;
+    size_t offset;
+};
+
+/* API -----------------------------------------------------------------------*/
+
+/**
+ * @brief Creates an empty store.
+ *
+ * @return Pointer to the new store on success.
+ * @return NULL on failure.
+ */
+struct string_store *string_store_create(void);
+
+/**
+ * @brief Destroys 'store' along with all its strings.
+ */
+void string_store_destroy(struct string_store *store);
+
+/**
+ * @brief Adds a copy of the char array 'src' of length 'len' to 'store', and
+ * stores its handle in 'handle'.
+ *
+ * @return 0 on success.
+ * @return -EINVAL if 'store', 'src' or 'handle' are invalid.
+ * @return -ENOMEM on failure or if 'store' ran out of handles.
+ */
+int string_store_add_v(struct string_store *store, const char *src,
+                size_t len, uint32_t *handle);
+
+/**
+ * @brief Adds a copy of 'src' to 'store', see string_store_add_v().
+ */
+int string_store_add(struct string_store *store, const struct string *src,
+                uint32_t *handle);
+
+/**
+ * @brief Returns in 'view' a view of the string 'handle' of 'store'.
+ *
+ * @return 0 on success.
+ * @return -EINVAL if 'store', 'view' or 'handle' are invalid.
+ *
+ * @note The view is not null terminated, nor aligned. STRING_TAIL_PADDING
+ * bytes past its end are readable, as for the values of regular strings.
+ */
+int string_store_get(const struct string_store *store, uint32_t handle,
+                struct string_view *view);
+
+/**
+ * @brief Returns the number of strings of 'store'.
+ *
+ * @return The number of strings on success.
+ * @return -EINVAL if 'store' is invalid.
+ */
+ssize_t string_store_count(const struct string_store *store);
+
+/**
+ * @brief Prepares 'it' to iterate over the strings of 'store'.
+ *
+ * @return 0 on success.
+ * @return -EINVAL if 'it' or 'store' are invalid.
+ */
+int string_store_iter_init(struct string_store_iter *it,
+                const struct string_store *store);
+
+/**
+ * @brief Writes a view of the next string of 'it' into 'view', and its handle
+ * into 'handle' unless it is NULL.
+ *
+ * @return 1 if a string was written.
+ * @return 0 if there are no strings left.
+ * @return -EINVAL if 'it' or 'view' are invalid.
+ */
+int string_store_next(struct string_store_iter *it, struct string_view *view,
+                uint32_t *handle);
+
+#endif /* LIB_STRINGS_STORE_H */
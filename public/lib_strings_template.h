@@ -0,0 +1,73 @@
+/**
+ * @author Maxence ROBIN
+ * @brief Provides precompiled templates rendered into strings.
+ *
+ * A template is a text containing placeholders : '{{name}}' is replaced by the
+ * escaped value of 'name' and '{{{name}}}' by its raw value. Spaces around the
+ * name are ignored.
+ */
+
+#ifndef LIB_STRINGS_TEMPLATE_H
+#define LIB_STRINGS_TEMPLATE_H
+
+/* Includes ------------------------------------------------------------------*/
+
+#include "lib_strings.h"
+
+/* Definitions ---------------------------------------------------------------*/
+
+struct string_template;
+
+enum string_escape {
+    STRING_ESCAPE_NONE,
+    STRING_ESCAPE_HTML,
+    STRING_ESCAPE_JSON
+};
+
+/**
+ * @brief Resolves the placeholder 'name' into 'value'.
+ *
+ * @return 0 on success.
+ * @return A negative errno on failure, which aborts the rendering.
+ *
+ * @note 'value' only has to stay valid until the rendering returns. It must not
+ * view the rendered string.
+ */
+typedef int (*string_template_lookup)(void *ctx, struct string_view name,
+                struct string_view *value);
+
+/* API -----------------------------------------------------------------------*/
+
+/**
+ * @brief Compiles the template text 'src' of length 'len' into literal
+ * segments and placeholder slots.
+ *
+ * @return Pointer to the new template on success.
+ * @return NULL on failure or if 'src' is invalid or has an unterminated
+ * placeholder.
+ */
+struct string_template *string_template_compile(const char *src, size_t len);
+
+/**
+ * @brief Destroys 'tpl'.
+ */
+void string_template_destroy(struct string_template *tpl);
+
+/**
+ * @brief Renders 'tpl' into 'dest', replacing its content. Placeholders are
+ * resolved with 'lookup' and escaped according to 'escape'.
+ *
+ * @return 0 on success.
+ * @return -EINVAL if 'tpl', 'lookup' or 'dest' are invalid.
+ * @return -EPERM if 'dest' is frozen.
+ * @return -ENOMEM on failure.
+ * @return The error returned by 'lookup' if it fails.
+ *
+ * @note All the placeholders are resolved before 'dest' is resized once to
+ * the exact rendered length, 'dest' is left untouched on failure.
+ */
+int string_template_render(const struct string_template *tpl,
+                string_template_lookup lookup, void *ctx,
+                enum string_escape escape, struct string *dest);
+
+#endif /* LIB_STRINGS_TEMPLATE_H */
@@ -0,0 +1,85 @@
+/**
+ * @author Maxence ROBIN
+ * @brief Fills a shared memory pool, releases every string, then refills it
+ * with strings of other sizes: released blocks must be split and merged back
+ * for the pool to take as much again.
+ */
+
+/* Includes ------------------------------------------------------------------*/
+
+#include "lib_strings_shm.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Definitions ---------------------------------------------------------------*/
+
+#define POOL_SIZE (64 * 1024)
+#define MAX_STRINGS 4096
+
+/* Static functions ----------------------------------------------------------*/
+
+/**
+ * @brief Fills 'shm' with strings of length 'len', whose handles are stored in
+ * 'handles'.
+ *
+ * @return The number of strings added.
+ */
+static size_t fill_pool(struct string_shm *shm, size_t len, uint64_t *handles)
+{
+        char src[256];
+        size_t count = 0;
+
+        memset(src, 'x', len);
+        while (count < MAX_STRINGS && string_shm_dup_v(shm, src, len,
+                        handles + count) == 0)
+                ++count;
+
+        return count;
+}
+
+static void empty_pool(struct string_shm *shm, const uint64_t *handles,
+                size_t count)
+{
+        for (size_t i = 0; i < count; ++i)
+                string_shm_put(shm, handles[i]);
+}
+
+/* Main ----------------------------------------------------------------------*/
+
+int main(void)
+{
+        static const size_t lens[] = {24, 1, 200, 24, 100, 1};
+        static uint64_t handles[MAX_STRINGS];
+        size_t first[sizeof(lens) / sizeof(*lens)];
+        int res = EXIT_SUCCESS;
+
+        struct string_shm *shm = string_shm_create(POOL_SIZE);
+        if (!shm) {
+                fprintf(stderr, "failed to create the pool\n");
+                return EXIT_FAILURE;
+        }
+
+        /* Each size must fit as many strings as in the fresh pool */
+        for (int round = 0; round < 2; ++round) {
+                for (size_t i = 0; i < sizeof(lens) / sizeof(*lens); ++i) {
+                        const size_t count = fill_pool(shm, lens[i], handles);
+
+                        if (round == 0)
+                                first[i] = count;
+
+                        if (count == 0 || count != first[i]) {
+                                fprintf(stderr, "%zu bytes strings : %zu "
+                                                "added, %zu expected\n",
+                                                lens[i], count, first[i]);
+                                res = EXIT_FAILURE;
+                        }
+
+                        empty_pool(shm, handles, count);
+                }
+        }
+
+        string_shm_destroy(shm);
+        return res;
+}
@@ -0,0 +1,426 @@
+/**
+ * @author Maxence ROBIN
+ * @brief Replays a trace recorded by a STRINGS_TRACE build of the library and
+ * reports the time, the allocations and the memory it took.
+ *
+ * Allocations are counted as the capacity changes of the replayed strings.
+ *
+ * The growth settings of the library are given on the command line, and other
+ * allocators can be compared by running the tool under LD_PRELOAD.
+ */
+
+/* Includes ------------------------------------------------------------------*/
+
+#define _GNU_SOURCE
+
+#include "lib_strings.h"
+#include "lib_strings_trace.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Definitions ---------------------------------------------------------------*/
+
+#define DEFAULT_HUGE_THRESHOLD ((size_t)2 * 1024 * 1024)
+
+struct trace {
+        unsigned char *data;
+        size_t len;
+        int with_content;
+};
+
+struct record {
+        enum trace_op op;
+        unsigned long id;
+        size_t a;
+        size_t b;
+        const char *content;
+};
+
+/**
+ * @brief Largest values found while checking a trace.
+ */
+struct trace_bounds {
+        unsigned long max_id;
+        size_t max_content;
+};
+
+struct replay_stats {
+        size_t ops;
+        size_t allocs;
+        size_t capacity;
+        size_t peak_capacity;
+        double seconds;
+};
+
+/* Static functions ----------------------------------------------------------*/
+
+static void usage(const char *name)
+{
+        fprintf(stderr, "Usage : %s [-m off|madvise|hugetlb] [-t threshold] "
+                        "[-s ratio:delay:min_capacity] trace\n", name);
+}
+
+/**
+ * @brief Loads the whole trace file 'path' into 'trace' and checks its
+ * header.
+ *
+ * @return 0 on success.
+ * @return A negative errno on failure.
+ */
+static int load_trace(const char *path, struct trace *trace)
+{
+        FILE *file = fopen(path, "rb");
+        if (!file)
+                return -errno;
+
+        int res = 0;
+        size_t capacity = 0;
+        trace->data = NULL;
+        trace->len = 0;
+
+        for (;;) {
+                if (trace->len == capacity) {
+                        capacity = capacity * 2 + 4096;
+                        unsigned char *data = realloc(trace->data, capacity);
+                        if (!data) {
+                                res = -ENOMEM;
+                                goto out;
+                        }
+                        trace->data = data;
+                }
+
+                const size_t read = fread(trace->data + trace->len, 1,
+                                capacity - trace->len, file);
+                trace->len += read;
+                if (read == 0)
+                        break;
+        }
+
+        if (ferror(file)) {
+                res = -EIO;
+                goto out;
+        }
+
+        if (trace->len < TRACE_MAGIC_LEN + 2
+                        || memcmp(trace->data, TRACE_MAGIC, TRACE_MAGIC_LEN)
+                        || trace->data[TRACE_MAGIC_LEN] != TRACE_VERSION) {
+                res = -EINVAL;
+                goto out;
+        }
+
+        trace->with_content = !!(trace->data[TRACE_MAGIC_LEN + 1]
+                        & TRACE_FLAG_CONTENT);
+out:
+        fclose(file);
+        if (res < 0)
+                free(trace->data);
+
+        return res;
+}
+
+/**
+ * @brief Decodes the LEB128 value at '*pos' into 'value'.
+ *
+ * @return 0 on success.
+ * @return -EINVAL if the value is truncated or too large.
+ */
+static int get_varint(const unsigned char **pos, const unsigned char *end,
+                unsigned long long *value)
+{
+        *value = 0;
+
+        for (unsigned int shift = 0; shift < 64; shift += 7) {
+                if (*pos == end)
+                        return -EINVAL;
+
+                const unsigned char byte = *(*pos)++;
+                *value |= (unsigned long long)(byte & 0x7f) << shift;
+                if (!(byte & 0x80))
+                        return 0;
+        }
+
+        return -EINVAL;
+}
+
+static int carries_content(enum trace_op op)
+{
+        return op == TRACE_CREATE || op == TRACE_COPY || op == TRACE_APPEND
+                        || op == TRACE_PREPEND || op == TRACE_PRINTF;
+}
+
+/**
+ * @brief Decodes the record at '*pos' into 'record'. Its content is NULL if
+ * the trace holds none.
+ *
+ * @return 0 on success.
+ * @return -EINVAL if the record is invalid.
+ */
+static int next_record(const struct trace *trace, const unsigned char **pos,
+                struct record *record)
+{
+        const unsigned char *end = trace->data + trace->len;
+        unsigned long long id, a, b;
+
+        record->op = (enum trace_op)*(*pos)++;
+        if (record->op >= TRACE_OP_COUNT || get_varint(pos, end, &id) < 0
+                        || get_varint(pos, end, &a) < 0
+                        || get_varint(pos, end, &b) < 0
+                        || id > ULONG_MAX || a > SIZE_MAX || b > SIZE_MAX)
+                return -EINVAL;
+
+        record->id = (unsigned long)id;
+        record->a = (size_t)a;
+        record->b = (size_t)b;
+        record->content = NULL;
+
+        if (trace->with_content && carries_content(record->op)) {
+                if (record->a > (size_t)(end - *pos))
+                        return -EINVAL;
+
+                record->content = (const char *)*pos;
+                *pos += record->a;
+        }
+
+        return 0;
+}
+
+/**
+ * @brief Checks every record of 'trace' before replaying it, and finds the
+ * bounds needed to set the replay up.
+ *
+ * @return 0 on success.
+ * @return -EINVAL if 'trace' is invalid.
+ */
+static int check_trace(const struct trace *trace, struct trace_bounds *bounds)
+{
+        const unsigned char *pos = trace->data + TRACE_MAGIC_LEN + 2;
+        const unsigned char *end = trace->data + trace->len;
+        struct record record;
+
+        bounds->max_id = 0;
+        bounds->max_content = 0;
+
+        while (pos < end) {
+                if (next_record(trace, &pos, &record) < 0)
+                        return -EINVAL;
+
+                if (record.id > bounds->max_id)
+                        bounds->max_id = record.id;
+                if (carries_content(record.op)
+                                && record.a > bounds->max_content)
+                        bounds->max_content = record.a;
+        }
+
+        return 0;
+}
+
+/**
+ * @brief Replays 'record' on the handle 'str', which is NULL for a new one.
+ * 'filler' stands for the content missing from the trace.
+ *
+ * @return The handle after the operation, NULL once destroyed.
+ */
+static struct string *replay_record(const struct record *record,
+                struct string *str, const char *filler)
+{
+        const char *content = (record->content ? record->content : filler);
+        const int printf_len = (record->a < INT_MAX ? (int)record->a
+                        : INT_MAX);
+
+        switch (record->op) {
+        case TRACE_CREATE:
+                return string_dup_v(content, record->a);
+        case TRACE_RESERVED:
+                return string_reserved(record->a);
+        case TRACE_DESTROY:
+                string_destroy(str);
+                return NULL;
+        case TRACE_COPY:
+                string_copy_v(str, content, record->a);
+                break;
+        case TRACE_APPEND:
+                string_append_v(str, content, record->a);
+                break;
+        case TRACE_PREPEND:
+                string_prepend_v(str, content, record->a);
+                break;
+        case TRACE_CUT:
+                string_cut(str, record->b, record->a);
+                break;
+        case TRACE_RESIZE:
+                string_resize(str, record->a);
+                break;
+        case TRACE_CLEAR:
+                string_clear(str);
+                break;
+        case TRACE_RESERVE:
+                string_reserve(str, record->a);
+                break;
+        case TRACE_FIT:
+                string_fit(str);
+                break;
+        case TRACE_PRINTF:
+                string_printf(str, "%.*s", printf_len, content);
+                break;
+        default:
+                break;
+        }
+
+        return str;
+}
+
+static size_t capacity_of(const struct string *str)
+{
+        return (str ? (size_t)string_capacity(str) : 0);
+}
+
+/**
+ * @brief Replays 'trace' with 'handles' able to hold all its ids, and fills
+ * 'stats'. The strings left alive by the trace are destroyed afterwards.
+ */
+static void replay_trace(const struct trace *trace, struct string **handles,
+                unsigned long count, const char *filler,
+                struct replay_stats *stats)
+{
+        const unsigned char *pos = trace->data + TRACE_MAGIC_LEN + 2;
+        const unsigned char *end = trace->data + trace->len;
+        struct timespec start, stop;
+        struct record record;
+
+        memset(stats, 0, sizeof(*stats));
+        clock_gettime(CLOCK_MONOTONIC, &start);
+
+        while (pos < end) {
+                next_record(trace, &pos, &record);
+
+                struct string **str = handles + record.id;
+                const int creates = (record.op == TRACE_CREATE
+                                || record.op == TRACE_RESERVED);
+                if (!*str && !creates)
+                        continue;
+
+                const size_t before = capacity_of(*str);
+                *str = replay_record(&record, *str, filler);
+                const size_t after = capacity_of(*str);
+
+                ++stats->ops;
+                if (after != before && *str)
+                        ++stats->allocs;
+
+                stats->capacity += after - before;
+                if (stats->capacity > stats->peak_capacity)
+                        stats->peak_capacity = stats->capacity;
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &stop);
+        stats->seconds = (double)(stop.tv_sec - start.tv_sec)
+                        + (double)(stop.tv_nsec - start.tv_nsec) / 1e9;
+
+        for (unsigned long i = 0; i <= count; ++i) {
+                string_destroy(handles[i]);
+                handles[i] = NULL;
+        }
+}
+
+/**
+ * @brief Applies the settings given on the command line.
+ *
+ * @return 0 on success.
+ * @return -EINVAL if an option is invalid.
+ */
+static int parse_options(int argc, char *argv[])
+{
+        enum string_huge_mode huge = STRING_HUGE_OFF;
+        size_t threshold = DEFAULT_HUGE_THRESHOLD;
+        unsigned int ratio = 0, delay = 0;
+        size_t min_capacity = 0;
+        int opt;
+
+        while ((opt = getopt(argc, argv, "m:t:s:")) != -1) {
+                switch (opt) {
+                case 'm':
+                        if (strcmp(optarg, "off") == 0)
+                                huge = STRING_HUGE_OFF;
+                        else if (strcmp(optarg, "madvise") == 0)
+                                huge = STRING_HUGE_MADVISE;
+                        else if (strcmp(optarg, "hugetlb") == 0)
+                                huge = STRING_HUGE_HUGETLB;
+                        else
+                                return -EINVAL;
+                        break;
+                case 't':
+                        threshold = strtoull(optarg, NULL, 0);
+                        break;
+                case 's':
+                        if (sscanf(optarg, "%u:%u:%zu", &ratio, &delay,
+                                        &min_capacity) != 3)
+                                return -EINVAL;
+                        break;
+                default:
+                        return -EINVAL;
+                }
+        }
+
+        if (optind != argc - 1)
+                return -EINVAL;
+
+        const int res = string_set_huge_pages(huge, threshold);
+        if (res < 0)
+                return res;
+
+        return string_set_shrink_policy(ratio, delay, min_capacity);
+}
+
+/* Main ----------------------------------------------------------------------*/
+
+int main(int argc, char *argv[])
+{
+        struct trace trace;
+        struct trace_bounds bounds = {0};
+        struct replay_stats stats;
+        struct rusage usage_info;
+
+        if (parse_options(argc, argv) < 0) {
+                usage(argv[0]);
+                return EXIT_FAILURE;
+        }
+
+        int res = load_trace(argv[optind], &trace);
+        if (res == 0)
+                res = check_trace(&trace, &bounds);
+        if (res < 0) {
+                fprintf(stderr, "%s : %s\n", argv[optind], strerror(-res));
+                return EXIT_FAILURE;
+        }
+
+        struct string **handles = calloc(bounds.max_id + 1, sizeof(*handles));
+        char *filler = malloc(bounds.max_content + 1);
+        if (!handles || !filler) {
+                fprintf(stderr, "%s\n", strerror(ENOMEM));
+                return EXIT_FAILURE;
+        }
+
+        memset(filler, 'x', bounds.max_content);
+        replay_trace(&trace, handles, bounds.max_id, filler, &stats);
+        getrusage(RUSAGE_SELF, &usage_info);
+
+        printf("operations    : %zu\n", stats.ops);
+        printf("time          : %.3f ms (%.1f ns/op)\n", stats.seconds * 1e3,
+                        (stats.ops ? stats.seconds * 1e9 / stats.ops : 0.0));
+        printf("allocations   : %zu\n", stats.allocs);
+        printf("peak capacity : %zu bytes\n", stats.peak_capacity);
+        printf("peak RSS      : %ld kB\n", usage_info.ru_maxrss);
+
+        free(filler);
+        free(handles);
+        free(trace.data);
+        return EXIT_SUCCESS;
+}
@@ -0,0 +1,106 @@
+/**
+ * @author Maxence ROBIN
+ * @brief Training workload run by the PGO build to profile the hot paths of
+ * the library : appends, formatting and copies of strings of various sizes.
+ */
+
+/* Includes ------------------------------------------------------------------*/
+
+#include "lib_strings.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Definitions ---------------------------------------------------------------*/
+
+#define ROUNDS 2000
+#define FIELDS 64
+
+/* Static functions ----------------------------------------------------------*/
+
+/**
+ * @brief Builds a line of fields with appends and formatted numbers, the way
+ * logs and serialized records are.
+ */
+static int build_line(struct string *line, struct string *field, int round)
+{
+        int res = string_copy_c(line, "record:");
+        if (res < 0)
+                return res;
+
+        for (int i = 0; i < FIELDS; ++i) {
+                if (string_printf(field, "%d=%x", i, round * i) < 0)
+                        return -1;
+
+                res = string_append(line, field);
+                if (res == 0)
+                        res = string_append_v(line, ";", 1);
+                if (res < 0)
+                        return res;
+        }
+
+        return string_prepend_c(line, "> ");
+}
+
+/**
+ * @brief Duplicates, cuts and copies 'line' into short-lived strings.
+ */
+static int split_line(const struct string *line)
+{
+        struct string *copy = string_dup(line);
+        if (!copy)
+                return -1;
+
+        const size_t len = (size_t)string_len(copy);
+        int res = string_cut(copy, 2, len / 2 - 2);
+
+        struct string *sub = string_sub_v(line->value, len / 2, len / 4);
+        if (!sub)
+                res = -1;
+        else if (res == 0)
+                res = string_copy(copy, sub);
+
+        string_destroy(sub);
+        string_destroy(copy);
+        return res;
+}
+
+/* Main ----------------------------------------------------------------------*/
+
+int main(void)
+{
+        struct string *line = string_empty();
+        struct string *field = string_empty();
+        struct string *big = string_empty();
+        int res = (line && field && big ? 0 : -1);
+
+        for (int round = 0; round < ROUNDS && res == 0; ++round) {
+                res = build_line(line, field, round);
+                if (res == 0)
+                        res = split_line(line);
+                if (res == 0)
+                        res = string_append(big, line);
+
+                struct string *formatted = string_format("%s/%d",
+                                field->value, round);
+                if (!formatted)
+                        res = -1;
+                string_destroy(formatted);
+
+                if (round % 256 == 255) {
+                        string_clear(big);
+                        string_fit(big);
+                }
+        }
+
+        string_destroy(big);
+        string_destroy(field);
+        string_destroy(line);
+
+        if (res < 0) {
+                fprintf(stderr, "Training workload failed\n");
+                return EXIT_FAILURE;
+        }
+
+        return EXIT_SUCCESS;
+}